@@ -35,10 +35,17 @@ struct SessionData: Codable, Identifiable {
     let state: String
     let slot: Int
     let led_index: Int
-    let idle_seconds: Double
+    var page: Int? = nil                // LED page the slot lives on
+    var idle_seconds: Double? = nil     // /api/sessions only
+    var last_event_at: Double? = nil    // wall clock; the stream sends only this
     let iterm_session: String
 
     var id: String { session_id }
+
+    var idleSeconds: Double {
+        if let t = last_event_at { return Date().timeIntervalSince1970 - t }
+        return idle_seconds ?? 0
+    }
 }
 
 struct EventData: Codable, Identifiable {
@@ -56,19 +63,46 @@ struct EventData: Codable, Identifiable {
 struct StatusData: Codable {
     let connected: Bool
     let `protocol`: String
-    let uptime_seconds: Double
+    var uptime_seconds: Double? = nil   // /api/status only
+    var started_at: Double? = nil       // wall clock; the stream sends only this
     let slots_used: Int
     let slots_total: Int
+    var page: Int? = nil                // page the keyboard is showing
+    var pages: Int? = nil               // pages in use
+    var firmware: FirmwarePerf? = nil   // keyboard perf counters, when connected
+    var keyboards: Int? = nil           // boards connected
+
+    var uptimeSeconds: Double {
+        if let t = started_at { return Date().timeIntervalSince1970 - t }
+        return uptime_seconds ?? 0
+    }
+
+    /// " ×2" when more than one board is connected
+    var boardCount: String {
+        if let n = keyboards, n > 1 { return " ×\(n)" }
+        return ""
+    }
+}
+
+struct FirmwarePerf: Codable {
+    let rx: Int
+    let tx: Int
+    let invalid: Int
+    let stale: Int
+    let events_lost: Int
+    let render_max_us: Int
+    let render_last_us: Int
 }
 
 struct SessionsResponse: Codable { let sessions: [SessionData] }
 struct EventsResponse: Codable { let events: [EventData] }
+struct SessionRemoved: Codable { let session_id: String }
 
 // MARK: - ViewModel
 
 @Observable
 final class DashboardViewModel {
-    var status = StatusData(connected: false, protocol: "", uptime_seconds: 0, slots_used: 0, slots_total: 8)
+    var status = StatusData(connected: false, protocol: "", slots_used: 0, slots_total: 8)
     var sessions: [SessionData] = []
     var events: [EventData] = []
     var filterText = ""
@@ -91,78 +125,92 @@ final class DashboardViewModel {
         }
     }
 
-    private var pollTimer: Timer?
-    private var pollErrors = 0
-
-    func startPolling() {
-        pollTimer?.invalidate()
-        pollTimer = Timer.scheduledTimer(withTimeInterval: 0.5, repeats: true) { [weak self] _ in
-            self?.poll()
+    // Updates arrive over /api/stream (Server-Sent Events): a snapshot on
+    // connect, then only changes, so an idle daemon sends nothing.
+    private var streamTask: Task<Void, Never>?
+    private var streamErrors = 0
+
+    private let streamSession: URLSession = {
+        let config = URLSessionConfiguration.default
+        config.timeoutIntervalForRequest = 86400  // silence is normal on an idle stream
+        config.timeoutIntervalForResource = 86400
+        return URLSession(configuration: config)
+    }()
+
+    func startStreaming() {
+        streamTask?.cancel()
+        streamTask = Task { [weak self] in
+            while !Task.isCancelled {
+                guard let self else { return }
+                await self.stream()
+                try? await Task.sleep(nanoseconds: 1_000_000_000)
+            }
         }
-        poll()
     }
 
-    func stopPolling() {
-        pollTimer?.invalidate()
-        pollTimer = nil
+    func stopStreaming() {
+        streamTask?.cancel()
+        streamTask = nil
     }
 
-    private func poll() {
-        let group = DispatchGroup()
-        var newStatus: StatusData?
-        var newSessions: [SessionData]?
-        var newEvents: [EventData]?
-        var hadError = false
-
-        group.enter()
-        fetch(StatusData.self, path: "/api/status") { result in
-            if case .success(let s) = result { newStatus = s } else { hadError = true }
-            group.leave()
-        }
-
-        group.enter()
-        fetch(SessionsResponse.self, path: "/api/sessions") { result in
-            if case .success(let r) = result { newSessions = r.sessions } else { hadError = true }
-            group.leave()
-        }
-
-        group.enter()
-        fetch(EventsResponse.self, path: "/api/events?n=200") { result in
-            if case .success(let r) = result { newEvents = r.events } else { hadError = true }
-            group.leave()
-        }
-
-        group.notify(queue: .main) { [weak self] in
-            guard let self else { return }
-            if hadError {
-                self.pollErrors += 1
-                if self.pollErrors > 5 {
-                    self.connectionState = .error("Dashboard disconnected")
+    private func stream() async {
+        guard let url = URL(string: API_BASE + "/api/stream") else { return }
+        do {
+            let (bytes, response) = try await streamSession.bytes(from: url)
+            guard (response as? HTTPURLResponse)?.statusCode == 200 else {
+                throw URLError(.badServerResponse)
+            }
+            // The daemon sends one "event:" line and one "data:" line per message
+            var kind = ""
+            for try await line in bytes.lines {
+                if line.hasPrefix("event: ") {
+                    kind = String(line.dropFirst(7))
+                } else if line.hasPrefix("data: ") {
+                    let data = Data(line.dropFirst(6).utf8)
+                    let k = kind
+                    await MainActor.run { self.apply(k, data) }
                 }
-            } else {
-                self.pollErrors = 0
-                if let s = newStatus { self.status = s }
-                if let s = newSessions { self.sessions = s.sorted { $0.slot < $1.slot } }
-                if let e = newEvents { self.events = e }
-                self.connectionState = .connected
+            }
+        } catch {}
+        await MainActor.run {
+            self.streamErrors += 1
+            if self.streamErrors > 5 {
+                self.connectionState = .error("Dashboard disconnected")
             }
         }
     }
 
-    private func fetch<T: Decodable>(_ type: T.Type, path: String, completion: @escaping (Result<T, Error>) -> Void) {
-        guard let url = URL(string: API_BASE + path) else { return }
-        URLSession.shared.dataTask(with: url) { data, response, error in
-            if let error { completion(.failure(error)); return }
-            guard let data, (response as? HTTPURLResponse)?.statusCode == 200 else {
-                completion(.failure(URLError(.badServerResponse))); return
+    private func apply(_ kind: String, _ data: Data) {
+        let decoder = JSONDecoder()
+        switch kind {
+        case "status":
+            if let s = try? decoder.decode(StatusData.self, from: data) { status = s }
+        case "sessions":
+            if let r = try? decoder.decode(SessionsResponse.self, from: data) {
+                sessions = r.sessions.sorted { $0.slot < $1.slot }
+            }
+        case "session":
+            if let s = try? decoder.decode(SessionData.self, from: data) {
+                sessions.removeAll { $0.session_id == s.session_id }
+                sessions.append(s)
+                sessions.sort { $0.slot < $1.slot }
+            }
+        case "session_removed":
+            if let r = try? decoder.decode(SessionRemoved.self, from: data) {
+                sessions.removeAll { $0.session_id == r.session_id }
             }
-            do {
-                let decoded = try JSONDecoder().decode(type, from: data)
-                completion(.success(decoded))
-            } catch {
-                completion(.failure(error))
+        case "events":
+            if let r = try? decoder.decode(EventsResponse.self, from: data) { events = r.events }
+        case "event":
+            if let e = try? decoder.decode(EventData.self, from: data) {
+                events.append(e)
+                if events.count > 200 { events.removeFirst(events.count - 200) }
             }
-        }.resume()
+        default:
+            return
+        }
+        streamErrors = 0
+        connectionState = .connected
     }
 
     // MARK: Stats
@@ -260,7 +308,7 @@ struct DashboardView: View {
         HStack(alignment: .top, spacing: 20) {
             VStack(alignment: .leading, spacing: 8) {
                 SectionHeader("Keyboard")
-                KeyboardGridView(sessions: vm.sessions)
+                KeyboardGridView(sessions: vm.sessions, page: vm.status.page ?? 0)
             }
             VStack(alignment: .leading, spacing: 8) {
                 SectionHeader("Sessions")
@@ -294,15 +342,27 @@ struct StatusBarView: View {
                 .fill(status.connected ? Color.kbd_green : Color.kbd_red)
                 .frame(width: 7, height: 7)
 
-            Text(status.connected ? "Connected (\(status.protocol))" : "Disconnected")
+            Text(status.connected ? "Connected (\(status.protocol)\(status.boardCount))" : "Disconnected")
                 .font(.system(size: 12))
                 .foregroundColor(.textDim)
 
             Divider().frame(height: 16)
 
-            Label("Uptime", content: formatDuration(status.uptime_seconds))
+            // Ticks locally; the stream only sends status when it changes
+            TimelineView(.periodic(from: .now, by: 1)) { _ in
+                Label("Uptime", content: formatDuration(status.uptimeSeconds))
+            }
             Divider().frame(height: 16)
             Label("Slots", content: "\(status.slots_used)/\(status.slots_total)")
+            if let pages = status.pages, pages > 1 {
+                Divider().frame(height: 16)
+                Label("Page", content: "\((status.page ?? 0) + 1)/\(pages)")
+            }
+            if let fw = status.firmware {
+                Divider().frame(height: 16)
+                Label("Render", content: "\(fw.render_last_us)/\(fw.render_max_us)µs")
+                Label("HID", content: "rx \(fw.rx) tx \(fw.tx) bad \(fw.invalid + fw.stale)")
+            }
         }
         .padding(.horizontal, 16)
         .padding(.vertical, 10)
@@ -323,13 +383,12 @@ struct StatusBarView: View {
 
 struct KeyboardGridView: View {
     let sessions: [SessionData]
+    let page: Int
 
     private var ledMap: [Int: SessionData] {
         var map: [Int: SessionData] = [:]
-        for sess in sessions {
-            if sess.slot < SLOT_LEDS.count {
-                map[SLOT_LEDS[sess.slot]] = sess
-            }
+        for sess in sessions where (sess.page ?? 0) == page {
+            map[sess.led_index] = sess
         }
         return map
     }
@@ -369,7 +428,7 @@ struct KeyCellView: View {
 
     @ViewBuilder
     func cellContent(time: Double) -> some View {
-        let isStale = session.map { $0.idle_seconds > DIM_TIMEOUT } ?? false
+        let isStale = session.map { $0.idleSeconds > DIM_TIMEOUT } ?? false
         let state = session?.state ?? ""
 
         ZStack {
@@ -537,7 +596,7 @@ struct SessionCardView: View {
 
             Spacer()
 
-            Text(formatDuration(session.idle_seconds))
+            Text(formatDuration(session.idleSeconds))
                 .font(.system(size: 11, design: .monospaced))
                 .foregroundColor(.textMuted)
         }
@@ -797,7 +856,7 @@ class AppDelegate: NSObject, NSApplicationDelegate {
 
     func applicationWillTerminate(_ notification: Notification) {
         checkTimer?.invalidate()
-        vm.stopPolling()
+        vm.stopStreaming()
         killDaemon()
     }
 
@@ -942,7 +1001,7 @@ class AppDelegate: NSObject, NSApplicationDelegate {
             let stderr = String(data: data, encoding: .utf8)?.trimmingCharacters(in: .whitespacesAndNewlines) ?? ""
             let lastLines = stderr.split(separator: "\n").suffix(3).joined(separator: "\n")
             DispatchQueue.main.async {
-                self.vm.stopPolling()
+                self.vm.stopStreaming()
                 let msg = lastLines.isEmpty ? "Keyboard service stopped unexpectedly" : "Daemon error:\n\(lastLines)"
                 self.vm.connectionState = .error(msg)
             }
@@ -975,7 +1034,7 @@ class AppDelegate: NSObject, NSApplicationDelegate {
                     DispatchQueue.main.async {
                         timer.invalidate()
                         self?.vm.connectionState = .connected
-                        self?.vm.startPolling()
+                        self?.vm.startStreaming()
                     }
                 }
             }.resume()
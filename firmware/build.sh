@@ -17,6 +17,8 @@ FIRMWARE_DIR="firmware"
 QMK_HOME="${QMK_HOME:-$HOME/qmk_firmware}"
 VIAL_QMK_HOME="${VIAL_QMK_HOME:-$HOME/vial-qmk}"
 KB_PATH="keyboards/work_louder/micro"
+SRAM_BYTES=2560       # ATmega32u4
+MIN_STACK_BYTES=512   # SRAM that has to stay free above .data/.bss
 
 # ── Helpers ─────────────────────────────────────
 
@@ -33,6 +35,23 @@ check_qmk() {
     fi
 }
 
+# Static RAM of the built image: fail if it leaves the stack less than MIN_STACK_BYTES
+check_sram() {
+    local elf="$1"
+    if [ ! -f "$elf" ] || ! command -v avr-size &>/dev/null; then
+        echo "Skipping SRAM check (no $elf or avr-size)"
+        return
+    fi
+    local used
+    used=$(avr-size -A "$elf" | awk '$1 == ".data" || $1 == ".bss" || $1 == ".noinit" { n += $2 } END { print n + 0 }')
+    local left=$((SRAM_BYTES - used))
+    echo "Static RAM: $used of $SRAM_BYTES bytes, $left left for the stack"
+    if [ "$left" -lt "$MIN_STACK_BYTES" ]; then
+        red "Less than $MIN_STACK_BYTES bytes of SRAM left for the stack; shrink the keymap state first."
+        exit 1
+    fi
+}
+
 # ── VIAL build ──────────────────────────────────
 
 build_vial() {
@@ -102,6 +121,7 @@ build_raw_hid() {
     echo
     if qmk compile -kb work_louder/micro -km raw_hid; then
         green "Raw HID build succeeded!"
+        check_sram "$QMK_HOME/.build/work_louder_micro_raw_hid.elf"
         HEX_FILE=$(find . -maxdepth 1 -name "work_louder_micro_raw_hid.*" -newer "$KEYMAP_DIR/keymap.c" | head -1)
         if [ -n "$HEX_FILE" ]; then
             cp "$HEX_FILE" "$OLDPWD/$FIRMWARE_DIR/"
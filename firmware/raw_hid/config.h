@@ -11,3 +11,11 @@
 #undef ENABLE_RGB_MATRIX_PIXEL_RAIN
 #undef ENABLE_RGB_MATRIX_PIXEL_FLOW
 #undef ENABLE_RGB_MATRIX_PIXEL_FRACTAL
+
+// Optional on-device features, off so the keymap fits the 32u4's flash next to QMK.
+// The daemon reads them from the ping reply and skips what's missing. Each costs
+// about this much flash (see CLAUDE.md before turning one on):
+// #define RAW_HID_STATUS_BAR_ENABLE // ug_mode 3 waiting-sessions bar, ~320B
+// #define RAW_HID_PERF_ENABLE       // 0x15 echo and 0x16 counters for --bench, ~540B
+// #define RAW_HID_PALETTE_ENABLE    // 0x12 palette and 0x13 indexed frames, ~840B
+// #define RAW_HID_FADE_ENABLE       // 0x11 crossfades, ~880B
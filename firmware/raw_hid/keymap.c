@@ -2,138 +2,969 @@
 // Raw HID keymap for Work Louder Micro — per-key LED control via custom protocol
 //
 // Protocol (32-byte HID reports):
-//   CMD 0x01: Set single LED    [0x01, led_idx, h, s, v]
-//   CMD 0x02: Set LED range     [0x02, start, count, h1,s1,v1, h2,s2,v2, ...]
+//   LED addr:  page << 4 | led_idx. The 8 session keys have one copy per page (NUM_PAGES); the other
+//              4 LEDs are shared by all pages. Page 0 is the default, so plain LED indexes still work.
+//   CMD 0x01: Set single LED    [0x01, led_addr, h, s, v]
+//   CMD 0x02: Set LED range     [0x02, start_addr, count, h1,s1,v1, h2,s2,v2, ...]
 //   CMD 0x03: Restore effect    [0x03]  — exits direct mode, resumes normal RGB
-//   CMD 0x04: Set all LEDs      [0x04, h, s, v]
+//   CMD 0x04: Set all LEDs      [0x04, h, s, v]  — every page
 //   CMD 0x05: Enter direct mode [0x05]  — responds [0x05, 0x01, led_count]
 //   CMD 0x06: Set underglow      [0x06, h, s, v]  — sets all 8 underglow LEDs
-//   CMD 0x07: Set blink          [0x07, led_idx, enable]  — 1=blink, 0=steady
+//   CMD 0x07: Set blink          [0x07, led_addr, enable]  — 1=blink, 0=steady
 //   CMD 0x08: Set blink speed    [0x08, period_ms_lo, period_ms_hi]  — default 500ms
 //   CMD 0x09: Bootloader         [0x09, 0xB0, 0x07]  — reboot into bootloader (magic bytes required)
 //   CMD 0x0A: Underglow breathe  [0x0A, h, s, v]  — breathing effect on underglow
-//   CMD 0xEE: Key event (out)    [0xEE, row, col]  — sent by firmware on key press in direct mode
-//   CMD 0xF0: Ping              [0xF0]  — responds [0xF0, 0x01, led_count]
+//   CMD 0x0B: Commit frame       [0x0B, h, s, v0..v11, blink_lo, blink_hi, ug_mode, ug_h, ug_s, ug_v, page]
+//             — replaces all 12 LEDs of a page (shared h/s, per-LED v), its blink mask and the underglow
+//               at once; enters direct mode if needed. ug_mode: 0=unchanged, 1=static, 2=breathing,
+//               3=status (RAW_HID_STATUS_BAR_ENABLE): one underglow LED per your-turn key on any page
+//               (see 0x10) lit in the color, the rest dim; breathing while none are waiting
+//   Underglow:   0x06, 0x0A and 0x0B leave the underglow alone if it already has that mode and color,
+//                so repeating them doesn't restart the breathing phase
+//   CMD 0x0C: Set LED effect     [0x0C, mask_lo, mask_hi, mode, period_lo, period_hi, min_v, max_v, phase]
+//             — animates V of every LED in mask (bits 0-11; bits 12-15 = page) between min_v..max_v;
+//               mode 0=none, 1=sine, 2=triangle,
+//               | 0x80 for gamma-eased ramps. phase is an offset in 1/256ths of the period.
+//               Cleared by 0x03/0x05/0x0B. Up to 7 distinct effects can be in use at once; one more
+//               responds 0xFF and changes nothing
+//   CMD 0x0D: Delta update       [0x0D, base_seq, start_addr, count, h1,s1,v1, ...]  — like 0x02 (count <= 9),
+//             applied only if base_seq matches; responds [0x0D, status, seq] with status
+//             0x01=applied, 0xFE=stale base (resync), 0xFF=bad range. 0x0B also responds [0x0B, 0x01, seq]
+//   CMD 0x0E: Host watchdog      [0x0E, timeout_lo, timeout_hi]  — arms (or feeds) the watchdog, 0=off.
+//             If no report arrives for timeout ms while in direct mode, LEDs show a "host lost"
+//             effect for 3 s, then normal RGB and the saved underglow return (as 0x03). Fires once;
+//             the host re-arms it when it comes back. Any valid command during those 3 s cancels the
+//             restore, so a host that returns keeps direct mode and repaints over the effect (byte 30
+//             of that command's reply already says so). Any report counts as host activity, and so
+//             does USB suspend (the host sleeping isn't the host going away).
+//             Responds [0x0E, 0x01, flags] with the state before this report: bit 0 = direct mode,
+//             bit 1 = the watchdog replaced the LED state since the last 0x0E (resend everything),
+//             bit 2 = the watchdog was armed
+//   CMD 0x0F: Set page count     [0x0F, count]  — pages in use (1..NUM_PAGES); responds [0x0F, 0x01, view_page].
+//             With more than one, pressing the right knob flips to the next page locally (the press
+//             isn't reported as a key) and LEDs 10/11 show which one. Knob turns are always events.
+//   CMD 0x10: Set slot states    [0x10, page, st0..st7]  — session state per key of a page:
+//             0=empty, 1=working, 2=your turn, 3=acknowledged. Pressing a your-turn key acknowledges it
+//             locally: its effect stops and the LED holds the effect's max_v, from the next frame on.
+//             The press is reported as usual, followed by an acknowledged event. Cleared by 0x03/0x05
+//   Optional:  0x11, 0x12/0x13 and 0x15/0x16 only exist with their RAW_HID_*_ENABLE (config.h), else 0xFF
+//   CMD 0x11: Set fade time      [0x11, ms_lo, ms_hi]  — from now on every visible LED change (any LED
+//             write, effect change, local acknowledge or page flip) crossfades on-device from the color
+//             on the LED to the new one over ms, linear in RGB. 0=off (the default): changes snap
+//   CMD 0x12: Set palette        [0x12, start, count, h1,s1,v1, ...]  — palette entries start.. (count <= 9,
+//             PALETTE_SIZE entries). LEDs last set from those entries by 0x13 are re-colored in place.
+//             Responds [0x12, status, seq]; always bumps the frame seq
+//   CMD 0x13: Indexed frame      [0x13, base_seq, page, i0|i1<<4, i2|i3<<4, ... i10|i11<<4]  — sets all 12
+//             LEDs of a page to palette entries, seq-checked and answered like 0x0D. Effects are kept
+//   CMD 0x15: Echo               [0x15, x, ...]  — responds [0x15, 0x01, now (4 bytes), rx_count (2 bytes),
+//             data[8..29] echoed]. now is timer_read32() when the report arrived, rx_count counts every
+//             report received since boot (no-ack ones too), so the host can measure latency, device-side
+//             report rate and drops; see vial_kbd.py --bench
+//   CMD 0x16: Perf counters      [0x16, reset]  — responds [0x16, 0x01, rx, tx, invalid, stale, ev_lost,
+//             render_max, render_last, ticks_per_ms] as uint16 little-endian: reports received and sent,
+//             commands answered 0xFF (unknown/bad) and 0xFE (stale delta), events dropped from a full
+//             queue, and the worst/latest rgb_matrix_indicators_user() time in ticks (ticks_per_ms per ms).
+//             Counters wrap; reset=1 clears render_max after reading
+//   Frame seq: bumped by every LED buffer write (0x01, 0x02, 0x04, 0x05, 0x0B, 0x0D, 0x12, 0x13,
+//              local acknowledge)
+//   Flag 0x40: No-ack            OR'd into any command 0x01–0x3F to suppress the reply report
+//   Byte 30:   Host state        every reply carries the 0x0E flags as they are after the command, so
+//                                a host that comes back learns the watchdog fired (bit 1, set until the
+//                                next 0x0E) from its first reply instead of its next keepalive
+//   Byte 31:   Request tag       copied from every host report into byte 31 of its reply, so the host
+//                                can keep several requests in flight; commands never use bytes 30-31
+//   CMD 0xEE: Events (out)       [0xEE, count, now_lo, now_hi, {type, row, col, t_lo, t_hi} x count]
+//             — queued key presses/releases (type 0x01=down, 0x02=up) stamped with the scan time,
+//               drained up to 5 per report from the main loop. count bit 0x80 = events were lost.
+//               type 0x03=encoder: row=encoder index, col=signed ticks accumulated since the last report
+//               type 0x04=page flipped (right knob press): row=new visible page
+//               type 0x05=acknowledged locally: row=slot within the page, col=frame seq after the change
+//               type bits 4-7 = visible page when the event happened
+//               now is timer_read() at send time so the host can convert stamps to its own clock
+//   CMD 0xF0: Ping              [0xF0]  — responds [0xF0, 0x01, led_count, NUM_PAGES, features]
+//             features: bit 0 = fades (0x11), bit 1 = status bar (ug_mode 3), bit 2 = perf (0x15/0x16),
+//             bit 3 = palette (0x12/0x13)
 
 #include QMK_KEYBOARD_H
 #include "raw_hid.h"
+#include "lib/lib8tion/lib8tion.h"
+#if defined(__AVR__)
+#    include <util/atomic.h>
+#endif
 
 #define NUM_LEDS 12
+#define ALL_LEDS ((1 << NUM_LEDS) - 1)
+
+#ifndef NUM_PAGES
+#    define NUM_PAGES 4 // session-key pages held in RAM
+#endif
+#define PAGING         (NUM_PAGES > 1)
+#define SLOTS_PER_PAGE 8
+#define NUM_VLEDS      (NUM_LEDS + (NUM_PAGES - 1) * SLOTS_PER_PAGE) // stored LEDs over all pages
+#define NO_LED         0xFF
+#define NO_SLOT        0xFF
+#define PAGE_KEY_ROW   0 // right knob press
+#define PAGE_KEY_COL   3
+#define PAGE_IND_A     10
+#define PAGE_IND_B     11
+
+#define CMD_NO_ACK 0x40 // command flag: don't send a reply
+
+#define UG_MODE_KEEP    0
+#define UG_MODE_STATIC  1
+#define UG_MODE_BREATHE 2
+#define UG_MODE_STATUS  3
+
+// Optional features (config.h), off by default for flash; reported by 0xF0 so the host skips what's missing
+#define FEAT_FADE       0x01 // RAW_HID_FADE_ENABLE: 0x11 crossfades
+#define FEAT_STATUS_BAR 0x02 // RAW_HID_STATUS_BAR_ENABLE: ug_mode 3
+#define FEAT_PERF       0x04 // RAW_HID_PERF_ENABLE: 0x15 echo, 0x16 perf counters
+#define FEAT_PALETTE    0x08 // RAW_HID_PALETTE_ENABLE: 0x12 palette, 0x13 indexed frames
+
+#if defined(RAW_HID_FADE_ENABLE)
+#    define HAS_FADE FEAT_FADE
+#else
+#    define HAS_FADE 0
+#endif
+#if defined(RAW_HID_STATUS_BAR_ENABLE)
+#    define HAS_STATUS_BAR FEAT_STATUS_BAR
+#else
+#    define HAS_STATUS_BAR 0
+#endif
+#if defined(RAW_HID_PERF_ENABLE)
+#    define HAS_PERF FEAT_PERF
+#else
+#    define HAS_PERF 0
+#endif
+#if defined(RAW_HID_PALETTE_ENABLE)
+#    define HAS_PALETTE FEAT_PALETTE
+#else
+#    define HAS_PALETTE 0
+#endif
+#define FEATURES (HAS_FADE | HAS_STATUS_BAR | HAS_PERF | HAS_PALETTE)
+
+#if defined(RGBLIGHT_LED_COUNT)
+#    define UG_LEDS RGBLIGHT_LED_COUNT
+#else
+#    define UG_LEDS RGBLED_NUM
+#endif
+
+#define FX_NONE     0
+#define FX_SINE     1
+#define FX_TRIANGLE 2
+#define FX_GAMMA    0x80 // mode flag: perceptual (gamma) easing of the ramp
+
+#define EV_KEY_DOWN 0x01
+#define EV_KEY_UP   0x02
+#define EV_ENCODER  0x03
+#define EV_PAGE     0x04
+#define EV_ACK      0x05
 
+#define SLOT_EMPTY     0
+#define SLOT_WORKING   1
+#define SLOT_YOUR_TURN 2
+#define SLOT_ACKED     3
+#define SLOT_ROW       1 // first matrix row of session keys, 4 slots per row
+#define SLOT_BITS      2 // slot_state bits per key
+
+#define FX_PALETTE 8    // distinct effect descriptors at once, entry 0 = no effect
+#define PALETTE_SIZE 16 // colors for 0x13, 4-bit indexes
+#define NO_FX      0xFF
+
+// Every static below has to leave QMK its matrix, RGB and USB buffers and the stack.
+// On AVR it measures 357 bytes with the optional features off, 543 with all of them on;
+// firmware/build.sh checks what the whole image leaves for the stack.
+#define RAM_BUDGET 576 // bytes
+
+#define HOST_LOST_MS 3000 // how long the "host lost" effect runs before restoring
+
+#define EVQ_SIZE       16 // power of two
+#define EVQ_PER_REPORT 5
+#define EVQ_LOST       0x80 // count flag in 0xEE reports
+
+// Queued event for the host, see 0xEE
+typedef struct {
+    uint8_t  type;
+    uint8_t  a; // row, or encoder index
+    uint8_t  b; // col, or int8_t tick delta
+    uint16_t time;
+} kbd_event_t;
+
+// Per-LED brightness animation, evaluated every frame in rgb_matrix_indicators_user()
+typedef struct {
+    uint8_t  mode;
+    uint8_t  min_v;
+    uint8_t  max_v;
+    uint8_t  phase; // offset in 1/256ths of a period
+    uint16_t rate;  // theta advance per ms, 4.12 fixed point (256 theta = one period)
+} led_fx_t;
+
+// Per-LED state is kept as parallel arrays indexed by stored LED (vled()) or physical LED,
+// with one bit per LED in 16-bit masks for flags. LEDs share effect descriptors by index.
 static bool     direct_mode = false;
-static uint8_t  led_buf[NUM_LEDS][3]; // h, s, v per LED
-static uint16_t blink_mask = 0;       // bit per LED: 1=blinking
-static uint16_t blink_period = 500;   // ms per full on/off cycle
+static uint8_t  led_buf[NUM_VLEDS][3];   // h, s, v per stored LED, see vled()
+static uint16_t blink_mask[NUM_PAGES];   // bit per physical LED: 1=blinking
+static uint16_t blink_period = 500;      // ms per full on/off cycle
+static led_fx_t fx_palette[FX_PALETTE];  // effects in use; [0] stays FX_NONE
+static uint8_t  led_fx[NUM_VLEDS];       // fx_palette index per stored LED, 0 = no effect
+#if defined(RAW_HID_PALETTE_ENABLE)
+static uint8_t  palette[PALETTE_SIZE][3];        // h, s, v, see 0x12
+static uint8_t  led_pal[(NUM_VLEDS + 1) / 2];    // palette index per stored LED, two per byte
+static uint8_t  pal_linked[(NUM_VLEDS + 7) / 8]; // bit per stored LED: color comes from led_pal
+#endif
+static RGB      rgb_buf[NUM_LEDS];       // cached colors of the visible page; full-V for animated LEDs
+static uint16_t rgb_dirty = ALL_LEDS;    // bit per physical LED: rgb_buf entry needs recomputing
+#if defined(RAW_HID_FADE_ENABLE)
+static RGB      rgb_shown[NUM_LEDS];     // color each LED got last frame, where fades start from
+static RGB      fade_from[NUM_LEDS];
+static uint16_t fade_start[NUM_LEDS];    // timer_read() when the fade began
+static uint16_t fade_mask = 0;           // bit per physical LED: fading towards its rendered color
+static uint16_t fade_ms   = 0;           // see 0x11, 0=off
+#endif
+static uint8_t  page_count = 1;          // pages in use, set by 0x0F
+static uint8_t  view_page  = 0;          // page on the keys, flipped locally by the PAGE_KEY press
+static uint16_t slot_state[NUM_PAGES];  // SLOT_* per session key, SLOT_BITS each, see 0x10
+static uint8_t  frame_seq = 0;        // bumped on every led_buf write; host detects missed deltas
+
+static uint8_t ug_mode = UG_MODE_KEEP; // underglow as last set by us, KEEP = unknown (EEPROM settings)
+static uint8_t ug_hsv[3];
+#if defined(RAW_HID_STATUS_BAR_ENABLE)
+static uint8_t ug_bar = 0xFF;          // lit LEDs of the UG_MODE_STATUS bar as drawn, 0xFF = not drawn
+#endif
+
+static uint16_t host_timeout = 0;     // watchdog in ms, 0=disarmed (see 0x0E)
+static uint32_t host_last    = 0;     // timer_read32() at the last host report
+static bool     host_lost    = false; // "host lost" effect running
+static bool     host_reset   = false; // the watchdog replaced the LED state; reported by 0x0E
+static uint32_t host_lost_at = 0;
+
+static kbd_event_t evq[EVQ_SIZE];     // ring buffer drained by housekeeping_task_user()
+static uint8_t     evq_head = 0;      // next write
+static uint8_t     evq_tail = 0;      // next read
+static bool        evq_lost = false;  // queue overflowed since the last report
+#if defined(RAW_HID_PERF_ENABLE)
+// Perf counters, reported by 0x15 and 0x16
+static uint16_t rx_count       = 0; // reports received since boot
+static uint16_t tx_count       = 0; // raw_hid_send() calls
+static uint16_t invalid_count  = 0; // commands answered 0xFF
+static uint16_t stale_count    = 0; // commands answered 0xFE
+static uint16_t evq_lost_count = 0; // events dropped by queue_event()
+static uint16_t render_max     = 0; // rgb_matrix_indicators_user() in perf ticks
+static uint16_t render_last    = 0;
+#endif
+#if defined(ENCODER_MAP_ENABLE)
+static int8_t   enc_delta[NUM_ENCODERS]; // ticks not yet reported, CW positive
+static uint16_t enc_time[NUM_ENCODERS];  // time of the latest tick
+#endif
+
+// Every static above, per feature, so none can slip past RAM_BUDGET; add new ones here
+#if defined(RAW_HID_PALETTE_ENABLE)
+#    define PALETTE_STATE (sizeof(palette) + sizeof(led_pal) + sizeof(pal_linked))
+#else
+#    define PALETTE_STATE 0
+#endif
+#if defined(RAW_HID_FADE_ENABLE)
+#    define FADE_STATE                                                                                  \
+        (sizeof(rgb_shown) + sizeof(fade_from) + sizeof(fade_start) + sizeof(fade_mask) + sizeof(fade_ms))
+#else
+#    define FADE_STATE 0
+#endif
+#if defined(RAW_HID_STATUS_BAR_ENABLE)
+#    define STATUS_BAR_STATE sizeof(ug_bar)
+#else
+#    define STATUS_BAR_STATE 0
+#endif
+#if defined(RAW_HID_PERF_ENABLE)
+#    define PERF_STATE                                                                                  \
+        (sizeof(rx_count) + sizeof(tx_count) + sizeof(invalid_count) + sizeof(stale_count) +            \
+         sizeof(evq_lost_count) + sizeof(render_max) + sizeof(render_last))
+#else
+#    define PERF_STATE 0
+#endif
+#if defined(ENCODER_MAP_ENABLE)
+#    define ENCODER_STATE (sizeof(enc_delta) + sizeof(enc_time))
+#else
+#    define ENCODER_STATE 0
+#endif
+#define LED_STATE                                                                                       \
+    (sizeof(direct_mode) + sizeof(led_buf) + sizeof(blink_mask) + sizeof(blink_period) +                \
+     sizeof(fx_palette) + sizeof(led_fx) + sizeof(rgb_buf) + sizeof(rgb_dirty) + sizeof(page_count) +   \
+     sizeof(view_page) + sizeof(slot_state) + sizeof(frame_seq) + sizeof(ug_mode) + sizeof(ug_hsv))
+#define HOST_STATE                                                                                      \
+    (sizeof(host_timeout) + sizeof(host_last) + sizeof(host_lost) + sizeof(host_reset) +                \
+     sizeof(host_lost_at) + sizeof(evq) + sizeof(evq_head) + sizeof(evq_tail) + sizeof(evq_lost))
+#define KEYMAP_STATE (LED_STATE + HOST_STATE + ENCODER_STATE + PALETTE_STATE + FADE_STATE + STATUS_BAR_STATE + PERF_STATE)
+_Static_assert(KEYMAP_STATE <= RAM_BUDGET, "keymap state outgrew RAM_BUDGET, check NUM_PAGES/FX_PALETTE/EVQ_SIZE");
+_Static_assert(SLOTS_PER_PAGE * SLOT_BITS <= 16, "slot_state entry too small for a page");
+_Static_assert(FX_PALETTE <= 8, "fx_intern() tracks palette use in a uint8_t");
 
 // No custom keycodes — keys are dead (KC_NO), only used for 0xEE event reporting
 
+// ---- Effect tables (PROGMEM) ----
+
+// Rising quarter of a raised cosine: (1 - cos(pi * t / 128)) / 2 * 255 for t = 0..64
+static const uint8_t PROGMEM sine_quarter[65] = {
+      0,   0,   0,   0,   1,   1,   1,   2,   2,   3,   4,   5,   5,   6,   7,   9,
+     10,  11,  12,  14,  15,  17,  18,  20,  21,  23,  25,  27,  29,  31,  33,  35,
+     37,  40,  42,  44,  47,  49,  52,  54,  57,  59,  62,  65,  67,  70,  73,  76,
+     79,  82,  85,  88,  90,  93,  97, 100, 103, 106, 109, 112, 115, 118, 121, 124,
+    127,
+};
+
+// Gamma 2.2: round(255 * (i / 255) ^ 2.2)
+static const uint8_t PROGMEM gamma_table[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+// Physical LED → position among the session keys, NO_SLOT for shared LEDs (matches SLOT_LEDS on the host)
+static const uint8_t PROGMEM led_slot[NUM_LEDS] = {
+    NO_SLOT, NO_SLOT, 4, 5, 6, 7, 3, 2, 1, 0, NO_SLOT, NO_SLOT,
+};
+
+// Session key position → physical LED, the inverse of led_slot
+static const uint8_t PROGMEM slot_led[SLOTS_PER_PAGE] = {9, 8, 7, 6, 2, 3, 4, 5};
+
 // ---- Helpers ----
 
-static inline void set_led_rgb(uint8_t idx, uint8_t h, uint8_t s, uint8_t v) {
-    HSV hsv = {.h = h, .s = s, .v = v};
-    RGB rgb = hsv_to_rgb(hsv);
-    rgb_matrix_set_color(idx, rgb.r, rgb.g, rgb.b);
+// Storage index of a physical LED on a page. Page 0 and the shared LEDs use
+// indexes 0..11, later pages only store their session keys.
+static uint8_t vled(uint8_t page, uint8_t led) {
+    if (led >= NUM_LEDS || page >= NUM_PAGES) return NO_LED;
+    uint8_t slot = pgm_read_byte(&led_slot[led]);
+    if (page == 0 || slot == NO_SLOT) return led;
+    return NUM_LEDS + (page - 1) * SLOTS_PER_PAGE + slot;
+}
+
+static inline uint8_t addr_page(uint8_t addr) {
+    return addr >> 4;
+}
+
+static inline uint8_t addr_led(uint8_t addr) {
+    return addr & 0x0F;
+}
+
+// Write a stored LED's color directly; it no longer follows the palette
+static void put_led(uint8_t v, uint8_t h, uint8_t s, uint8_t val) {
+    led_buf[v][0] = h;
+    led_buf[v][1] = s;
+    led_buf[v][2] = val;
+#if defined(RAW_HID_PALETTE_ENABLE)
+    pal_linked[v >> 3] &= ~(1 << (v & 7));
+#endif
+}
+
+#if defined(RAW_HID_PALETTE_ENABLE)
+// Set a stored LED to a palette entry and keep following it
+static void put_led_indexed(uint8_t v, uint8_t idx) {
+    memcpy(led_buf[v], palette[idx], 3);
+    led_pal[v >> 1] = v & 1 ? (led_pal[v >> 1] & 0x0F) | (idx << 4) : (led_pal[v >> 1] & 0xF0) | idx;
+    pal_linked[v >> 3] |= 1 << (v & 7);
+}
+#endif
+
+// Mark the visible copy of a stored LED for recomputation
+static inline void mark_dirty(uint8_t page, uint8_t led) {
+    if (page == view_page || pgm_read_byte(&led_slot[led]) == NO_SLOT) rgb_dirty |= 1 << led;
+}
+
+// Write an LED of a page and mark it for the next frame. Returns its storage index.
+static uint8_t set_led(uint8_t page, uint8_t led, uint8_t h, uint8_t s, uint8_t val) {
+    uint8_t v = vled(page, led);
+    put_led(v, h, s, val);
+    mark_dirty(page, led);
+    return v;
+}
+
+// Write count LEDs from addr on from h, s, v triples (0x01, 0x02, 0x0D). False for a bad range.
+static bool write_leds(uint8_t addr, uint8_t count, const uint8_t *hsv) {
+    uint8_t page  = addr_page(addr);
+    uint8_t start = addr_led(addr);
+    if (page >= NUM_PAGES || start + count > NUM_LEDS || count > 9) return false;
+    for (uint8_t i = 0; i < count; i++, hsv += 3) set_led(page, start + i, hsv[0], hsv[1], hsv[2]);
+    frame_seq++;
+    return true;
+}
+
+static void set_view_page(uint8_t page) {
+    view_page = page;
+    rgb_dirty = ALL_LEDS;
+}
+
+// Smooth 0→255→0 wave over theta 0..255, starting at 0
+static uint8_t sine_wave8(uint8_t theta) {
+    if (theta > 128) theta = 256 - theta;
+    if (theta > 64) return 255 - pgm_read_byte(&sine_quarter[128 - theta]);
+    return pgm_read_byte(&sine_quarter[theta]);
+}
+
+static inline uint8_t triangle_wave8(uint8_t theta) {
+    return theta < 128 ? theta * 2 : (255 - theta) * 2;
+}
+
+static inline uint8_t gamma8(uint8_t x) {
+    return pgm_read_byte(&gamma_table[x]);
+}
+
+// a + (b - a) * t / 255 for a <= b, exact at both ends
+static inline uint8_t lerp8(uint8_t a, uint8_t b, uint8_t t) {
+    uint8_t d = b - a;
+    return a + (uint8_t)(((uint16_t)t * d + d) >> 8);
+}
+
+// LEDs 10/11 show the visible page while more than one is in use
+static inline bool is_page_indicator(uint8_t led) {
+    return PAGING && page_count > 1 && (led == PAGE_IND_A || led == PAGE_IND_B);
+}
+
+// Page 0 white, later pages step through cyan → blue → pink
+static HSV page_indicator_hsv(void) {
+    return (HSV){.h = 128 + (view_page - 1) * 48, .s = view_page ? 255 : 0, .v = 120};
+}
+
+#if defined(RAW_HID_FADE_ENABLE)
+// a + (b - a) * t / 256 for either order of a and b
+static inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t t) {
+    return a <= b ? a + (((uint16_t)(b - a) * t) >> 8) : a - (((uint16_t)(a - b) * t) >> 8);
+}
+#endif
+
+// Refresh rgb_buf for LEDs touched by HID commands (or a page flip) since the last frame.
+// Each one starts a fade from what it shows now, if fades are on.
+static void update_rgb_cache(void) {
+#if defined(RAW_HID_FADE_ENABLE)
+    uint16_t now = timer_read();
+    if (fade_ms) {
+        for (uint8_t i = 0; i < NUM_LEDS; i++) {
+            if (rgb_dirty & (1 << i)) {
+                fade_from[i]  = rgb_shown[i];
+                fade_start[i] = now;
+            }
+        }
+        fade_mask |= rgb_dirty;
+    }
+#endif
+    for (uint8_t i = 0; i < NUM_LEDS; i++) {
+        if (is_page_indicator(i)) {
+            rgb_buf[i] = hsv_to_rgb(page_indicator_hsv());
+        } else if (rgb_dirty & (1 << i)) {
+            uint8_t v   = vled(view_page, i);
+            HSV     hsv = {.h = led_buf[v][0], .s = led_buf[v][1], .v = led_buf[v][2]};
+            if (led_fx[v]) hsv.v = 255; // scaled per frame by fx_value()
+            rgb_buf[i] = hsv_to_rgb(hsv);
+        }
+    }
+    rgb_dirty = 0;
+}
+
+// Current brightness of an animated LED. Waveform starts at min_v when theta is 0.
+// Only the low 20 bits of now * rate matter, so 32-bit wraparound is harmless.
+static uint8_t fx_value(const led_fx_t *fx, uint32_t now) {
+    uint8_t theta = (uint8_t)((now * fx->rate) >> 12) + fx->phase;
+    uint8_t wave  = (fx->mode & ~FX_GAMMA) == FX_SINE ? sine_wave8(theta) : triangle_wave8(theta);
+    if (fx->mode & FX_GAMMA) wave = gamma8(wave);
+    return lerp8(fx->min_v, fx->max_v, wave);
+}
+
+// Palette index of an effect, adding it if new. Entries no LED points at are reused.
+// Returns 0 for FX_NONE and NO_FX if FX_PALETTE distinct effects are already in use.
+static uint8_t fx_intern(const led_fx_t *fx) {
+    if (fx->mode == FX_NONE) return 0;
+    uint8_t used = 1;
+    for (uint8_t i = 0; i < NUM_VLEDS; i++) used |= 1 << led_fx[i];
+    uint8_t free = NO_FX;
+    for (uint8_t i = 1; i < FX_PALETTE; i++) {
+        if (!(used & (1 << i))) {
+            if (free == NO_FX) free = i;
+        } else if (!memcmp(&fx_palette[i], fx, sizeof(*fx))) {
+            return i;
+        }
+    }
+    if (free != NO_FX) fx_palette[free] = *fx;
+    return free;
+}
+
+static inline uint8_t get_slot_state(uint8_t page, uint8_t slot) {
+    return (slot_state[page] >> (slot * SLOT_BITS)) & ((1 << SLOT_BITS) - 1);
+}
+
+static inline void set_slot_state(uint8_t page, uint8_t slot, uint8_t st) {
+    uint8_t shift    = slot * SLOT_BITS;
+    slot_state[page] = (slot_state[page] & ~(((1 << SLOT_BITS) - 1) << shift)) | ((uint16_t)st << shift);
+}
+
+// ---- Perf counters ----
+
+#if defined(RAW_HID_PERF_ENABLE)
+#    define PERF_COUNT(counter) ((counter)++)
+#else
+#    define PERF_COUNT(counter)
+#endif
+
+#if defined(RAW_HID_PERF_ENABLE) && defined(__AVR__)
+#    define PERF_TICKS_PER_MS (F_CPU / 64 / 1000) // QMK's ms timer: Timer0 at F_CPU/64, cleared every ms
+
+// Sub-millisecond clock: QMK's ms count plus Timer0's position within the ms
+static uint32_t perf_ticks(void) {
+    uint32_t ms;
+    uint8_t  t;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ms = timer_read32();
+        t  = TCNT0;
+        if (TIFR0 & _BV(OCF0A)) { // compare match pending: TCNT0 wrapped but the ms isn't counted yet
+            ms++;
+            t = TCNT0;
+        }
+    }
+    return ms * PERF_TICKS_PER_MS + t;
+}
+#elif defined(RAW_HID_PERF_ENABLE)
+#    define PERF_TICKS_PER_MS 1
+static inline uint32_t perf_ticks(void) {
+    return timer_read32();
+}
+#endif
+
+static void send_report(uint8_t *report) {
+    raw_hid_send(report, 32);
+    PERF_COUNT(tx_count);
+}
+
+// ---- Event queue ----
+
+static void queue_event(uint8_t type, uint8_t a, uint8_t b, uint16_t time) {
+    uint8_t next = (evq_head + 1) & (EVQ_SIZE - 1);
+    if (next == evq_tail) {
+        evq_lost = true;
+        PERF_COUNT(evq_lost_count);
+        return;
+    }
+    evq[evq_head] = (kbd_event_t){.type = type | (view_page << 4), .a = a, .b = b, .time = time};
+    evq_head      = next;
+}
+
+// One 5-byte event record of an 0xEE report
+static void put_event(uint8_t *p, const kbd_event_t *ev) {
+    p[0] = ev->type;
+    p[1] = ev->a;
+    p[2] = ev->b;
+    p[3] = ev->time & 0xFF;
+    p[4] = ev->time >> 8;
+}
+
+// Send up to EVQ_PER_REPORT queued events; called from the main loop, never from matrix scan.
+// Encoder ticks are coalesced into one record per encoder ahead of the queued key events.
+static void flush_events(void) {
+    uint8_t  report[32] = {0};
+    uint8_t  count      = 0;
+    uint16_t now        = timer_read();
+    report[0]           = 0xEE;
+    report[2]           = now & 0xFF;
+    report[3]           = now >> 8;
+#if defined(ENCODER_MAP_ENABLE)
+    for (uint8_t i = 0; i < NUM_ENCODERS; i++) {
+        if (enc_delta[i]) {
+            kbd_event_t ev = {.type = EV_ENCODER, .a = i, .b = (uint8_t)enc_delta[i], .time = enc_time[i]};
+            put_event(&report[4 + count++ * 5], &ev);
+            enc_delta[i] = 0;
+        }
+    }
+#endif
+    while (evq_tail != evq_head && count < EVQ_PER_REPORT) {
+        put_event(&report[4 + count++ * 5], &evq[evq_tail]);
+        evq_tail = (evq_tail + 1) & (EVQ_SIZE - 1);
+    }
+    if (!count) return;
+    report[1] = count | (evq_lost ? EVQ_LOST : 0);
+    evq_lost  = false;
+    send_report(report);
+}
+
+// ---- Underglow ----
+
+#if defined(RAW_HID_STATUS_BAR_ENABLE)
+// Underglow LEDs of the status bar: one per waiting key, capped at UG_LEDS
+static uint8_t waiting_count(void) {
+    uint8_t n = 0;
+    for (uint8_t p = 0; p < NUM_PAGES; p++) {
+        for (uint8_t i = 0; i < SLOTS_PER_PAGE; i++) n += get_slot_state(p, i) == SLOT_YOUR_TURN;
+    }
+    return MIN(n, UG_LEDS);
+}
+
+// Redraw the status bar if the number of waiting keys changed
+static void update_status_bar(void) {
+    if (ug_mode != UG_MODE_STATUS) return;
+    uint8_t n = waiting_count();
+    if (n == ug_bar) return;
+    if (!n) {
+        rgblight_mode_noeeprom(RGBLIGHT_MODE_BREATHING);
+        rgblight_sethsv_noeeprom(ug_hsv[0], ug_hsv[1], ug_hsv[2]);
+    } else {
+        if (!ug_bar || ug_bar == 0xFF) rgblight_mode_noeeprom(RGBLIGHT_MODE_STATIC_LIGHT);
+        for (uint8_t i = 0; i < UG_LEDS; i++) {
+            RGB rgb = hsv_to_rgb((HSV){.h = ug_hsv[0], .s = ug_hsv[1], .v = i < n ? ug_hsv[2] : ug_hsv[2] / 8});
+            rgblight_setrgb_at(rgb.r, rgb.g, rgb.b, i);
+        }
+    }
+    ug_bar = n;
+}
+#else
+static inline void update_status_bar(void) {}
+#endif
+
+// Apply an underglow mode unless it's already showing, which would restart its animation
+static void set_underglow(uint8_t mode, uint8_t h, uint8_t s, uint8_t v) {
+#if defined(RAW_HID_STATUS_BAR_ENABLE)
+    if (mode == UG_MODE_KEEP || mode > UG_MODE_STATUS) return;
+    bool same_hsv  = h == ug_hsv[0] && s == ug_hsv[1] && v == ug_hsv[2];
+    bool breathing = same_hsv && (ug_mode == UG_MODE_BREATHE || (ug_mode == UG_MODE_STATUS && !ug_bar));
+#else
+    if (mode == UG_MODE_KEEP || mode > UG_MODE_BREATHE) return;
+    bool same_hsv  = h == ug_hsv[0] && s == ug_hsv[1] && v == ug_hsv[2];
+    bool breathing = same_hsv && ug_mode == UG_MODE_BREATHE;
+#endif
+    if (mode == ug_mode && same_hsv) return;
+    ug_mode   = mode;
+    ug_hsv[0] = h;
+    ug_hsv[1] = s;
+    ug_hsv[2] = v;
+#if defined(RAW_HID_STATUS_BAR_ENABLE)
+    if (mode == UG_MODE_STATUS) {
+        ug_bar = breathing ? 0 : 0xFF; // an empty bar is that same breathing
+        update_status_bar();
+        return;
+    }
+#endif
+    if (breathing && mode == UG_MODE_BREATHE) return;
+    rgblight_mode_noeeprom(mode == UG_MODE_STATIC ? RGBLIGHT_MODE_STATIC_LIGHT : RGBLIGHT_MODE_BREATHING);
+    rgblight_sethsv_noeeprom(h, s, v);
+}
+
+// ---- Local state transitions ----
+
+// A press on a your-turn key: show the acknowledged look now, tell the host after.
+// The look is the pulse's peak held solid; LEDs without an effect keep their value.
+static void acknowledge_slot(uint8_t slot, uint16_t time) {
+    if (get_slot_state(view_page, slot) != SLOT_YOUR_TURN) return;
+    uint8_t led = pgm_read_byte(&slot_led[slot]);
+    uint8_t v   = vled(view_page, led);
+    set_slot_state(view_page, slot, SLOT_ACKED);
+    if (led_fx[v]) put_led(v, led_buf[v][0], led_buf[v][1], fx_palette[led_fx[v]].max_v);
+    led_fx[v] = 0;
+    rgb_dirty |= 1 << led;
+    frame_seq++;
+    queue_event(EV_ACK, slot, frame_seq, time);
+    update_status_bar();
+}
+
+// ---- Host watchdog ----
+
+// Back to the normal RGB effect (0x03, and the watchdog once the host is gone)
+static void restore_normal(void) {
+    direct_mode = false;
+    memset(blink_mask, 0, sizeof(blink_mask));
+    memset(led_fx, 0, sizeof(led_fx));
+    memset(slot_state, 0, sizeof(slot_state));
+    update_status_bar();
+#if defined(RAW_HID_FADE_ENABLE)
+    memset(rgb_shown, 0, sizeof(rgb_shown)); // the next direct mode fades in from dark
+    fade_mask = 0;
+#endif
+    evq_tail = evq_head;
+}
+
+// Slow red pulse on every LED, drawn by the regular effect engine
+static void show_host_lost(void) {
+    memset(led_fx, 0, sizeof(led_fx));
+    fx_palette[1] = (led_fx_t){.mode = FX_SINE, .min_v = 0, .max_v = 160, .rate = (256UL << 12) / 1000};
+    for (uint8_t i = 0; i < NUM_LEDS; i++) { // page 0 holds every physical LED
+        put_led(i, 0, 255, 255);
+        led_fx[i] = 1;
+    }
+    memset(blink_mask, 0, sizeof(blink_mask));
+    page_count = 1;
+    set_view_page(0);
+    frame_seq++;
+    set_underglow(UG_MODE_STATIC, 0, 255, 64);
+    host_reset = true;
+}
+
+// 0x0E flags: bit 0 = direct mode, bit 1 = the watchdog replaced the LED state, bit 2 = armed
+static uint8_t host_flags(void) {
+    return direct_mode | host_reset << 1 | (host_timeout != 0) << 2;
+}
+
+static void check_host_watchdog(void) {
+    if (host_lost) {
+        if (timer_elapsed32(host_lost_at) >= HOST_LOST_MS) {
+            host_lost = false;
+            restore_normal();
+            rgblight_reload_from_eeprom();
+            ug_mode = UG_MODE_KEEP;
+        }
+    } else if (host_timeout && direct_mode && timer_elapsed32(host_last) > host_timeout) {
+        host_timeout = 0; // one-shot until the host re-arms it
+        host_lost    = true;
+        host_lost_at = timer_read32();
+        show_host_lost();
+    }
+}
+
+// Timer0 keeps counting while USB is suspended, so don't let a sleeping
+// host look like a lost one: the suspend loop keeps feeding the watchdog
+void suspend_power_down_user(void) {
+    host_last = timer_read32();
+}
+
+void suspend_wakeup_init_user(void) {
+    host_last = timer_read32();
 }
 
 // ---- Raw HID handler ----
 
 void raw_hid_receive(uint8_t *data, uint8_t length) {
     uint8_t cmd = data[0];
+    bool    ack = true;
+    if ((cmd & 0xC0) == CMD_NO_ACK) { // fire-and-forget variant
+        cmd &= ~CMD_NO_ACK;
+        ack = false;
+    }
     uint8_t response[32] = {0};
-    response[0] = cmd;
+    response[0]  = cmd;
+    response[1]  = 0x01;     // OK unless the command says otherwise
+    response[31] = data[31]; // request tag
+    host_last    = timer_read32();
+    PERF_COUNT(rx_count);
 
     switch (cmd) {
         case 0x01: { // Set single LED — just update buffer, indicators callback renders
-            uint8_t idx = data[1];
-            if (idx < NUM_LEDS && direct_mode) {
-                led_buf[idx][0] = data[2];
-                led_buf[idx][1] = data[3];
-                led_buf[idx][2] = data[4];
-            }
-            response[1] = 0x01;
+            if (direct_mode) write_leds(data[1], 1, &data[2]);
             break;
         }
         case 0x02: { // Set LED range
-            uint8_t start = data[1];
-            uint8_t count = data[2];
-            if (direct_mode && start + count <= NUM_LEDS && count <= 9) {
-                for (uint8_t i = 0; i < count; i++) {
-                    uint8_t idx = start + i;
-                    led_buf[idx][0] = data[3 + i * 3];
-                    led_buf[idx][1] = data[4 + i * 3];
-                    led_buf[idx][2] = data[5 + i * 3];
-                }
-            }
-            response[1] = 0x01;
+            if (direct_mode) write_leds(data[1], data[2], &data[3]);
             break;
         }
         case 0x03: { // Restore normal effect
-            direct_mode = false;
-            blink_mask = 0;
-            response[1] = 0x01;
+            restore_normal();
             break;
         }
-        case 0x04: { // Set all LEDs same color
+        case 0x04: { // Set all LEDs same color, on every page
             if (direct_mode) {
-                for (uint8_t i = 0; i < NUM_LEDS; i++) {
-                    led_buf[i][0] = data[1];
-                    led_buf[i][1] = data[2];
-                    led_buf[i][2] = data[3];
+                for (uint8_t i = 0; i < NUM_VLEDS; i++) {
+                    put_led(i, data[1], data[2], data[3]);
                 }
+                rgb_dirty = ALL_LEDS;
+                frame_seq++;
             }
-            response[1] = 0x01;
             break;
         }
         case 0x05: { // Enter direct mode
             direct_mode = true;
-            blink_mask = 0;
+            memset(blink_mask, 0, sizeof(blink_mask));
             memset(led_buf, 0, sizeof(led_buf));
-            response[1] = 0x01;
+#if defined(RAW_HID_PALETTE_ENABLE)
+            memset(pal_linked, 0, sizeof(pal_linked));
+#endif
+            memset(led_fx, 0, sizeof(led_fx));
+            memset(slot_state, 0, sizeof(slot_state));
+            update_status_bar();
+            rgb_dirty = ALL_LEDS;
+            frame_seq++;
             response[2] = NUM_LEDS;
             break;
         }
         case 0x06: { // Set underglow color (rgblight, 8 LEDs on D2)
-            rgblight_mode_noeeprom(RGBLIGHT_MODE_STATIC_LIGHT);
-            rgblight_sethsv_noeeprom(data[1], data[2], data[3]);
-            response[1] = 0x01;
+            set_underglow(UG_MODE_STATIC, data[1], data[2], data[3]);
             break;
         }
         case 0x07: { // Set blink for individual LED
-            uint8_t idx = data[1];
-            if (idx < NUM_LEDS) {
+            uint8_t page = addr_page(data[1]);
+            uint8_t led  = addr_led(data[1]);
+            if (vled(page, led) != NO_LED) {
                 if (data[2]) {
-                    blink_mask |= (1 << idx);
+                    blink_mask[page] |= (1 << led);
                 } else {
-                    blink_mask &= ~(1 << idx);
+                    blink_mask[page] &= ~(1 << led);
                 }
             }
-            response[1] = 0x01;
             break;
         }
         case 0x08: { // Set blink speed (period in ms)
             blink_period = data[1] | (data[2] << 8);
             if (blink_period < 50) blink_period = 50;
-            response[1] = 0x01;
             break;
         }
         case 0x0A: { // Underglow breathing effect
-            rgblight_mode_noeeprom(RGBLIGHT_MODE_BREATHING);
-            rgblight_sethsv_noeeprom(data[1], data[2], data[3]);
-            response[1] = 0x01;
+            set_underglow(UG_MODE_BREATHE, data[1], data[2], data[3]);
+            break;
+        }
+        case 0x0B: { // Commit full frame of one page in one report
+            uint8_t page = data[21];
+            if (page >= NUM_PAGES) {
+                response[1] = 0xFF;
+                break;
+            }
+            direct_mode = true;
+            for (uint8_t i = 0; i < NUM_LEDS; i++) led_fx[set_led(page, i, data[1], data[2], data[3 + i])] = 0;
+            blink_mask[page] = data[15] | (data[16] << 8);
+            set_underglow(data[17], data[18], data[19], data[20]);
+            frame_seq++;
+            response[2] = frame_seq;
+            break;
+        }
+        case 0x0C: { // Set per-LED effect for every LED in mask
+            uint16_t mask   = data[1] | (data[2] << 8);
+            uint8_t  page   = mask >> NUM_LEDS;
+            uint16_t period = data[4] | (data[5] << 8);
+            led_fx_t fx     = {
+                .mode  = data[3],
+                .min_v = MIN(data[6], data[7]),
+                .max_v = MAX(data[6], data[7]),
+                .phase = data[8],
+            };
+            if ((fx.mode & ~FX_GAMMA) > FX_TRIANGLE || period < 50) {
+                fx.mode = FX_NONE;
+            } else {
+                fx.rate = (256UL << 12) / period;
+            }
+            uint8_t idx = page < NUM_PAGES ? fx_intern(&fx) : NO_FX;
+            if (idx == NO_FX) { // bad page, or palette full
+                response[1] = 0xFF;
+                break;
+            }
+            for (uint8_t i = 0; i < NUM_LEDS; i++) {
+                if (mask & (1 << i)) {
+                    led_fx[vled(page, i)] = idx;
+                    mark_dirty(page, i);
+                }
+            }
+            break;
+        }
+        case 0x0D: { // Delta update, only applied on top of the frame the host last saw
+            if (!direct_mode || data[1] != frame_seq) {
+                response[1] = 0xFE;
+            } else {
+                response[1] = write_leds(data[2], data[3], &data[4]) ? 0x01 : 0xFF;
+            }
+            response[2] = frame_seq;
+            break;
+        }
+        case 0x0E: { // Arm/feed host watchdog
+            response[2]  = host_flags();
+            host_reset   = false;
+            host_timeout = data[1] | (data[2] << 8);
+            break;
+        }
+        case 0x0F: { // Set number of pages in use
+            page_count = data[1] < 1 ? 1 : MIN(data[1], NUM_PAGES);
+            if (view_page >= page_count) set_view_page(page_count - 1);
+            rgb_dirty |= (1 << PAGE_IND_A) | (1 << PAGE_IND_B);
+            response[2] = view_page;
+            break;
+        }
+        case 0x10: { // Set slot states of one page
+            if (data[1] < NUM_PAGES) {
+                for (uint8_t i = 0; i < SLOTS_PER_PAGE; i++) set_slot_state(data[1], i, data[2 + i] & ((1 << SLOT_BITS) - 1));
+                update_status_bar();
+            } else {
+                response[1] = 0xFF;
+            }
+            break;
+        }
+#if defined(RAW_HID_FADE_ENABLE)
+        case 0x11: { // Set crossfade time
+            fade_ms = data[1] | (data[2] << 8);
+            if (!fade_ms) fade_mask = 0;
+            break;
+        }
+#endif
+#if defined(RAW_HID_PALETTE_ENABLE)
+        case 0x12: { // Set palette entries, re-coloring the LEDs that follow them
+            uint8_t start = data[1];
+            uint8_t count = data[2];
+            if (start + count > PALETTE_SIZE || count > 9) {
+                response[1] = 0xFF;
+            } else {
+                memcpy(palette[start], &data[3], count * 3);
+                for (uint8_t v = 0; v < NUM_VLEDS; v++) {
+                    uint8_t idx = (led_pal[v >> 1] >> ((v & 1) * 4)) & 0x0F;
+                    if ((pal_linked[v >> 3] & (1 << (v & 7))) && idx >= start && idx < start + count) {
+                        memcpy(led_buf[v], palette[idx], 3);
+                        rgb_dirty = ALL_LEDS; // cheaper than mapping v back to its page and LED
+                    }
+                }
+                frame_seq++;
+            }
+            response[2] = frame_seq;
+            break;
+        }
+        case 0x13: { // Indexed frame: all 12 LEDs of a page from the palette
+            uint8_t page = data[2];
+            if (!direct_mode || data[1] != frame_seq) {
+                response[1] = 0xFE;
+            } else if (page >= NUM_PAGES) {
+                response[1] = 0xFF;
+            } else {
+                for (uint8_t i = 0; i < NUM_LEDS; i++) {
+                    put_led_indexed(vled(page, i), (data[3 + i / 2] >> ((i & 1) * 4)) & 0x0F);
+                    mark_dirty(page, i);
+                }
+                frame_seq++;
+            }
+            response[2] = frame_seq;
+            break;
+        }
+#endif
+#if defined(RAW_HID_PERF_ENABLE)
+        case 0x15: { // Echo with device timestamp, for benchmarking
+            response[2] = host_last & 0xFF;
+            response[3] = host_last >> 8;
+            response[4] = host_last >> 16;
+            response[5] = host_last >> 24;
+            response[6] = rx_count & 0xFF;
+            response[7] = rx_count >> 8;
+            memcpy(&response[8], &data[8], 22);
+            break;
+        }
+        case 0x16: { // Perf counters
+            uint16_t values[] = {rx_count,       tx_count,   invalid_count, stale_count,
+                                 evq_lost_count, render_max, render_last,   PERF_TICKS_PER_MS};
+            for (uint8_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+                response[2 + i * 2] = values[i] & 0xFF;
+                response[3 + i * 2] = values[i] >> 8;
+            }
+            if (data[1]) render_max = 0;
             break;
         }
+#endif
         case 0x09: { // Reboot into bootloader (requires magic bytes 0xB0, 0x07)
             if (data[1] == 0xB0 && data[2] == 0x07) {
-                response[1] = 0x01;
-                raw_hid_send(response, sizeof(response));
+                send_report(response);
                 reset_keyboard();
             }
             response[1] = 0xFF; // wrong magic
             break;
         }
         case 0xF0: { // Ping
-            response[1] = 0x01;
             response[2] = NUM_LEDS;
+            response[3] = NUM_PAGES;
+            response[4] = FEATURES;
             break;
         }
         default: {
@@ -141,20 +972,57 @@ void raw_hid_receive(uint8_t *data, uint8_t length) {
             break;
         }
     }
-    raw_hid_send(response, sizeof(response));
+#if defined(RAW_HID_PERF_ENABLE)
+    if (response[1] == 0xFF) invalid_count++;
+    if (response[1] == 0xFE) stale_count++;
+#endif
+    if (response[1] != 0xFF) host_lost = false; // host is back: cancel the pending restore
+    response[30] = host_flags();
+    if (ack) {
+        send_report(response);
+    }
 }
 
 // Apply direct-mode colors after normal RGB effect renders each frame
 bool rgb_matrix_indicators_user(void) {
     if (direct_mode) {
-        bool blink_on = (timer_read() % blink_period) < (blink_period / 2);
+#if defined(RAW_HID_PERF_ENABLE)
+        uint32_t start = perf_ticks();
+#endif
+        bool     blink_on = (timer_read() % blink_period) < (blink_period / 2);
+        uint32_t now      = timer_read32();
+        if (rgb_dirty) update_rgb_cache();
         for (uint8_t i = 0; i < NUM_LEDS; i++) {
-            if ((blink_mask & (1 << i)) && !blink_on) {
-                rgb_matrix_set_color(i, 0, 0, 0);
-            } else {
-                set_led_rgb(i, led_buf[i][0], led_buf[i][1], led_buf[i][2]);
+            RGB      rgb = rgb_buf[i];
+            led_fx_t *fx = &fx_palette[led_fx[vled(view_page, i)]];
+            if (is_page_indicator(i)) {
+                // cached color as is
+            } else if ((blink_mask[view_page] & (1 << i)) && !blink_on) {
+                rgb = (RGB){0, 0, 0};
+            } else if (fx->mode != FX_NONE) {
+                uint8_t v = fx_value(fx, now);
+                rgb       = (RGB){scale8(rgb.r, v), scale8(rgb.g, v), scale8(rgb.b, v)};
             }
+#if defined(RAW_HID_FADE_ENABLE)
+            if (fade_mask & (1 << i)) { // blend towards the live color, so effects fade in too
+                uint16_t elapsed = (uint16_t)now - fade_start[i];
+                if (elapsed >= fade_ms) {
+                    fade_mask &= ~(1 << i);
+                } else {
+                    uint8_t t = ((uint32_t)elapsed << 8) / fade_ms;
+                    rgb       = (RGB){blend8(fade_from[i].r, rgb.r, t), blend8(fade_from[i].g, rgb.g, t),
+                                      blend8(fade_from[i].b, rgb.b, t)};
+                }
+            }
+            rgb_shown[i] = rgb;
+#endif
+            rgb_matrix_set_color(i, rgb.r, rgb.g, rgb.b);
         }
+#if defined(RAW_HID_PERF_ENABLE)
+        uint32_t took = perf_ticks() - start;
+        render_last   = MIN(took, 0xFFFF);
+        render_max    = MAX(render_max, render_last);
+#endif
     }
     return true;
 }
@@ -171,17 +1039,44 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
 };
 
 bool process_record_user(uint16_t keycode, keyrecord_t *record) {
-    // Report key presses to daemon when in direct mode
-    if (direct_mode && record->event.pressed) {
-        uint8_t report[32] = {0};
-        report[0] = 0xEE;
-        report[1] = record->event.key.row;
-        report[2] = record->event.key.col;
-        raw_hid_send(report, sizeof(report));
+#if defined(ENCODER_MAP_ENABLE)
+    // Encoder ticks arrive as press/release pairs; accumulate presses, flush_events() batches them
+    if (IS_ENCODEREVENT(record->event)) {
+        if (direct_mode && record->event.pressed) {
+            uint8_t idx  = record->event.key.col;
+            int8_t  step = record->event.type == ENCODER_CW_EVENT ? 1 : -1;
+            if (idx < NUM_ENCODERS) {
+                if (enc_delta[idx] != 127 * step) enc_delta[idx] += step;
+                enc_time[idx] = record->event.time;
+            }
+        }
+        return true;
+    }
+#endif
+    // Queue key presses/releases for the daemon when in direct mode
+    if (direct_mode) {
+        uint8_t row = record->event.key.row;
+        uint8_t col = record->event.key.col;
+        if (PAGING && row == PAGE_KEY_ROW && col == PAGE_KEY_COL && page_count > 1) { // flip pages locally, tell the host
+            if (record->event.pressed) {
+                set_view_page(view_page + 1 < page_count ? view_page + 1 : 0);
+                queue_event(EV_PAGE, view_page, 0, record->event.time);
+            }
+            return true;
+        }
+        queue_event(record->event.pressed ? EV_KEY_DOWN : EV_KEY_UP, row, col, record->event.time);
+        if (record->event.pressed && row >= SLOT_ROW && row < SLOT_ROW + SLOTS_PER_PAGE / 4 && col < 4) {
+            acknowledge_slot((row - SLOT_ROW) * 4 + col, record->event.time);
+        }
     }
     return true;
 }
 
+void housekeeping_task_user(void) {
+    check_host_watchdog();
+    flush_events();
+}
+
 #if defined(ENCODER_MAP_ENABLE)
 const uint16_t PROGMEM encoder_map[][NUM_ENCODERS][NUM_DIRECTIONS] = {
     { ENCODER_CCW_CW(KC_VOLD, KC_VOLU), ENCODER_CCW_CW(KC_NO, KC_NO) },
@@ -1,2 +1,8 @@
 RAW_ENABLE = yes
 ENCODER_MAP_ENABLE = yes
+LTO_ENABLE = yes  # link-time optimization: the on-device effects need the flash headroom
+# Unused by this keymap (only KC_NO and the volume keys); frees flash for the on-device effects
+MOUSEKEY_ENABLE = no
+MAGIC_ENABLE = no
+SPACE_CADET_ENABLE = no
+GRAVE_ESC_ENABLE = no
@@ -1,10 +1,19 @@
 #!/bin/bash
-INPUT=$(cat)
-echo "$INPUT" | /usr/bin/jq -c --arg iterm "$ITERM_SESSION_ID" '{
+# Sends one JSON record per hook event to the daemon's Unix datagram socket.
+# Falls back to appending to the JSONL spool if the socket can't be reached.
+SOCK=/tmp/claude-kbd.sock
+SPOOL=/tmp/claude-kbd-events.jsonl
+
+REC=$(/usr/bin/jq -c --arg iterm "$ITERM_SESSION_ID" '{
   ts: now,
   session: .session_id,
   event: .hook_event_name,
   tool: (.tool_name // ""),
   notif: (.notification_type // ""),
   iterm_session: $iterm
-}' >> /tmp/claude-kbd-events.jsonl
+}')
+
+if [ -S "$SOCK" ] && printf '%s\n' "$REC" | nc -U -u -w0 "$SOCK" 2>/dev/null; then
+  exit 0
+fi
+echo "$REC" >> "$SPOOL"
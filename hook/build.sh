@@ -0,0 +1,14 @@
+#!/bin/bash
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+PROJECT_DIR="$(dirname "$SCRIPT_DIR")"
+BUILD_DIR="$PROJECT_DIR/build"
+
+echo "Building kbd-hook..."
+
+mkdir -p "$BUILD_DIR"
+cc -O2 -Wall -Wextra -o "$BUILD_DIR/kbd-hook" "$SCRIPT_DIR/kbd_hook.c"
+
+echo "Built: $BUILD_DIR/kbd-hook"
+echo "Run:   python3 setup_hooks.py  (uses kbd-hook instead of hook.sh when present)"
@@ -0,0 +1,203 @@
+/*
+ * kbd-hook — native Claude Code hook client for the keyboard daemon.
+ *
+ * Drop-in replacement for hook.sh without the bash/cat/jq process chain.
+ * Reads the hook JSON from stdin, picks out the top-level session_id,
+ * hook_event_name, tool_name and notification_type strings, and sends one
+ * compact record to the daemon's Unix datagram socket:
+ *
+ *   {"ts":<epoch>,"session":"..","event":"..","tool":"..","notif":"..","iterm_session":".."}
+ *
+ * If the socket can't be reached the record is appended to the JSONL spool,
+ * exactly like hook.sh. String values are copied in their escaped JSON form,
+ * so no unescaping or re-escaping is needed. Nested values (tool_input,
+ * tool_response) are skipped without being parsed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define EVENT_SOCKET "/tmp/claude-kbd.sock"
+#define STATE_FILE   "/tmp/claude-kbd-events.jsonl"
+
+#define FIELD_MAX 256   // longer values (never seen in practice) are dropped
+#define RECORD_MAX 1536
+
+typedef struct {
+    const char *key;
+    char        val[FIELD_MAX];
+} field_t;
+
+enum { F_SESSION, F_EVENT, F_TOOL, F_NOTIF, NUM_FIELDS };
+
+static field_t fields[NUM_FIELDS] = {
+    [F_SESSION] = {"session_id"},
+    [F_EVENT]   = {"hook_event_name"},
+    [F_TOOL]    = {"tool_name"},
+    [F_NOTIF]   = {"notification_type"},
+};
+
+static char *read_all(int fd, size_t *len) {
+    size_t cap = 16384, n = 0;
+    char  *buf = malloc(cap);
+    ssize_t r;
+    if (!buf) return NULL;
+    while ((r = read(fd, buf + n, cap - n)) > 0) {
+        n += (size_t)r;
+        if (n == cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) break;
+            buf = grown;
+            cap *= 2;
+        }
+    }
+    *len = n;
+    return buf;
+}
+
+static const char *skip_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+// p points at the opening quote; returns one past the closing quote (or end).
+// *body/*body_len receive the raw, still-escaped contents.
+static const char *scan_string(const char *p, const char *end, const char **body, size_t *body_len) {
+    const char *start = ++p;
+    while (p < end && *p != '"') {
+        if (*p == '\\' && p + 1 < end) p++;
+        p++;
+    }
+    *body     = start;
+    *body_len = (size_t)(p - start);
+    return p < end ? p + 1 : end;
+}
+
+// Skips any JSON value; containers are skipped by depth counting.
+static const char *skip_value(const char *p, const char *end) {
+    const char *s;
+    size_t      n;
+    int         depth = 0;
+    while (p < end) {
+        char c = *p;
+        if (c == '"') {
+            p = scan_string(p, end, &s, &n);
+            if (depth == 0) return p;
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) return p;  // end of the enclosing object
+            if (--depth == 0) return p + 1;
+        } else if (depth == 0 && c == ',') {
+            return p;
+        }
+        p++;
+    }
+    return p;
+}
+
+static void parse_hook(const char *p, const char *end) {
+    const char *key, *val;
+    size_t      key_len, val_len;
+
+    p = skip_ws(p, end);
+    if (p >= end || *p != '{') return;
+    p++;
+    while (p < end) {
+        p = skip_ws(p, end);
+        if (p >= end || *p == '}') return;
+        if (*p == ',') {
+            p++;
+            continue;
+        }
+        if (*p != '"') return;
+        p = scan_string(p, end, &key, &key_len);
+        p = skip_ws(p, end);
+        if (p >= end || *p != ':') return;
+        p = skip_ws(p + 1, end);
+        if (p >= end) return;
+        if (*p != '"') {
+            p = skip_value(p, end);
+            continue;
+        }
+        p = scan_string(p, end, &val, &val_len);
+        for (int i = 0; i < NUM_FIELDS; i++) {
+            if (strlen(fields[i].key) == key_len && memcmp(fields[i].key, key, key_len) == 0) {
+                if (val_len < FIELD_MAX) {
+                    memcpy(fields[i].val, val, val_len);
+                    fields[i].val[val_len] = '\0';
+                }
+                break;
+            }
+        }
+    }
+}
+
+// Environment values are raw, so escape them for the JSON record.
+static void escape_json(char *dst, size_t cap, const char *src) {
+    size_t n = 0;
+    for (; src && *src && n + 7 < cap; src++) {
+        unsigned char c = (unsigned char)*src;
+        if (c == '"' || c == '\\') {
+            dst[n++] = '\\';
+            dst[n++] = (char)c;
+        } else if (c < 0x20) {
+            n += (size_t)snprintf(dst + n, cap - n, "\\u%04x", c);
+        } else {
+            dst[n++] = (char)c;
+        }
+    }
+    dst[n] = '\0';
+}
+
+static int send_datagram(const char *rec, size_t len) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int                fd   = socket(AF_UNIX, SOCK_DGRAM, 0);
+    int                ok;
+    if (fd < 0) return 0;
+    strncpy(addr.sun_path, EVENT_SOCKET, sizeof(addr.sun_path) - 1);
+    ok = sendto(fd, rec, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len;
+    close(fd);
+    return ok;
+}
+
+static int append_spool(const char *rec, size_t len) {
+    int fd = open(STATE_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    int ok;
+    if (fd < 0) return 0;
+    ok = write(fd, rec, len) == (ssize_t)len;  // single O_APPEND write: lines from concurrent hooks don't interleave
+    close(fd);
+    return ok;
+}
+
+int main(void) {
+    struct timeval tv;
+    char           iterm[FIELD_MAX];
+    char           rec[RECORD_MAX];
+    size_t         in_len = 0;
+    char          *in     = read_all(STDIN_FILENO, &in_len);
+    int            len;
+
+    if (in) parse_hook(in, in + in_len);
+    escape_json(iterm, sizeof(iterm), getenv("ITERM_SESSION_ID"));
+    gettimeofday(&tv, NULL);
+
+    len = snprintf(rec, sizeof(rec),
+                   "{\"ts\":%ld.%06ld,\"session\":\"%s\",\"event\":\"%s\",\"tool\":\"%s\",\"notif\":\"%s\",\"iterm_session\":\"%s\"}\n",
+                   (long)tv.tv_sec, (long)tv.tv_usec, fields[F_SESSION].val, fields[F_EVENT].val,
+                   fields[F_TOOL].val, fields[F_NOTIF].val, iterm);
+    if (len <= 0 || len >= (int)sizeof(rec)) return 0;
+
+    if (!send_datagram(rec, (size_t)len) && !append_spool(rec, (size_t)len)) {
+        return 1;  // event lost (disk full?); 1 is a non-blocking hook error, so Claude carries on
+    }
+    return 0;
+}
@@ -8,7 +8,9 @@ import sys
 from pathlib import Path
 
 SETTINGS_PATH = Path.home() / ".claude" / "settings.json"
-HOOK_SCRIPT = str(Path(__file__).parent / "hook.sh")
+# Prefer the native client (hook/build.sh); hook.sh needs bash + jq per event
+HOOK_BINARY = Path(__file__).parent / "build" / "kbd-hook"
+HOOK_SCRIPT = str(HOOK_BINARY if HOOK_BINARY.exists() else Path(__file__).parent / "hook.sh")
 HOOK_COMMAND = f"{HOOK_SCRIPT}"
 
 # We need hooks on these events to track session state
@@ -24,14 +26,19 @@ def add_hooks():
     for event in EVENTS_TO_HOOK:
         matchers = hooks.setdefault(event, [])
 
-        # Check if we already added our hook
-        already = any(
-            MARKER in h.get("command", "")
-            for m in matchers
-            for h in m.get("hooks", [])
-        )
-        if already:
-            print(f"  {event}: already configured")
+        # Check if we already added our hook (switching hook.sh <-> kbd-hook in place)
+        ours = [
+            h for m in matchers for h in m.get("hooks", [])
+            if MARKER in h.get("command", "")
+        ]
+        if ours:
+            command = f"{HOOK_COMMAND}  # {MARKER}"
+            if all(h["command"] == command for h in ours):
+                print(f"  {event}: already configured")
+            else:
+                for h in ours:
+                    h["command"] = command
+                print(f"  {event}: updated to {Path(HOOK_SCRIPT).name}")
             continue
 
         # Append a new matcher entry with our hook
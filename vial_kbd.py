@@ -18,16 +18,24 @@ LED slot mapping (rows 1-2, left-to-right, top-to-bottom):
 Top row LEDs 10, 11: global attention indicator.
 """
 
+import asyncio
+import ctypes
+import ctypes.util
 import json
-import math
+import os
+import select
 import signal
+import socket
 import struct
 import subprocess
 import sys
 import time
+from collections import OrderedDict, deque, namedtuple
+import heapq
+import queue
 from pathlib import Path
 import threading
-from http.server import HTTPServer, BaseHTTPRequestHandler
+from http.server import ThreadingHTTPServer, BaseHTTPRequestHandler
 from urllib.parse import urlparse, parse_qs
 
 try:
@@ -36,7 +44,13 @@ except ImportError:
     print("Missing 'hidapi' package. Install with: pip install hidapi")
     sys.exit(1)
 
-STATE_FILE = Path("/tmp/claude-kbd-events.jsonl")
+EVENT_SOCKET = Path("/tmp/claude-kbd.sock")  # hook.sh sends one datagram per event
+STATE_FILE = Path("/tmp/claude-kbd-events.jsonl")  # fallback spool when the socket is unreachable
+SLOT_FILE = Path("/tmp/claude-kbd-slots.json")  # session → slot map kept across restarts
+HISTORY_FILE = Path("/tmp/claude-kbd-history.jsonl")  # bounded on-disk event log, seeds EventRing
+HISTORY_MAX_BYTES = 1_000_000  # rotated to .1 beyond this
+SPOOL_MAX_BYTES = 1_000_000
+EVENT_RING_SIZE = 500  # recent events kept in memory for /api/events
 
 # --- LED layout ---
 ROW_LEDS = {
@@ -47,11 +61,24 @@ ROW_LEDS = {
 }
 NUM_LEDS = 12
 
-# Slot → LED index (rows 1-2, left-to-right, top-to-bottom)
+# Slot → LED index (rows 1-2, left-to-right, top-to-bottom), repeated on every page
 SLOT_LEDS = [9, 8, 7, 6, 2, 3, 4, 5]
-MAX_SLOTS = len(SLOT_LEDS)
+SLOTS_PER_PAGE = len(SLOT_LEDS)
+NUM_PAGES = 4  # LED pages the firmware holds; pressing the right knob flips them on-device
+MAX_SLOTS = NUM_PAGES * SLOTS_PER_PAGE
+# Encoder and page-indicator LEDs: one copy in firmware, common to all pages
+SHARED_LEDS = [i for i in range(NUM_LEDS) if i not in SLOT_LEDS]
 
-# (row, col) → slot index for key press mapping
+
+def slot_page(slot):
+    return slot // SLOTS_PER_PAGE
+
+
+def slot_led(slot):
+    return SLOT_LEDS[slot % SLOTS_PER_PAGE]
+
+
+# (row, col) → slot index within a page for key press mapping
 KEY_TO_SLOT = {
     (1, 0): 0, (1, 1): 1, (1, 2): 2, (1, 3): 3,
     (2, 0): 4, (2, 1): 5, (2, 2): 6, (2, 3): 7,
@@ -60,6 +87,9 @@ KEY_TO_SLOT = {
 # Global indicator LEDs (top row)
 GLOBAL_LEDS = [10, 11]
 
+# Right knob cycles iTerm focus through sessions (left knob stays on volume)
+SESSION_ENCODER = 1
+
 # Orange in HSV (QMK scale: H=0-255, S=0-255, V=0-255)
 ORANGE_H, ORANGE_S, ORANGE_V = 9, 255, 200
 DIM_V = 80    # brightness for "working" state
@@ -72,13 +102,28 @@ YOUR_TURN_NOTIF = {"permission_prompt", "elicitation_dialog"}
 # Events that mean "claude is working"
 CLAUDE_WORKING = {"PreToolUse", "UserPromptSubmit"}
 
+SESSION_STATES = ("working", "your_turn", "acknowledged")
+# Firmware slot state codes (0x10); 0 = no session
+SLOT_STATE_CODES = {"working": 1, "your_turn": 2, "acknowledged": 3}
+
 # Session timeouts
 DIM_TIMEOUT = 300    # 5 min: dim LED if no events
 RELEASE_TIMEOUT = 600  # 10 min: release slot
 
-# Pulse animation
+# Pulse animation (rendered on-device by the firmware effect engine)
 PULSE_PERIOD = 2.0   # seconds for a full bright→dim→bright cycle
-PULSE_QUANT = 5      # quantize brightness to reduce USB traffic
+
+# Every look keyboard_image() uses, uploaded once so frames go out as 4-bit indexes (0x13)
+PALETTE = [
+    (0, 0, 0),
+    (ORANGE_H, ORANGE_S, ORANGE_V),
+    (ORANGE_H, ORANGE_S, DIM_V),
+    (ORANGE_H, ORANGE_S, STALE_V),
+]
+PALETTE_SIZE = 16
+
+# On-device crossfade between LED looks (0x11); 0 snaps
+FADE_MS = 250
 
 # Working state breathing (slower, gentler than pulse — like Claude logo)
 BREATHE_PERIOD = 3.0
@@ -94,99 +139,355 @@ RAW_HID_USAGE = 0x61
 MSG_LEN = 32
 
 CMD_KEY_EVENT = 0xEE
+EV_KEY_DOWN = 0x01
+EV_KEY_UP = 0x02
+EV_ENCODER = 0x03
+EV_PAGE = 0x04       # right knob press flipped the visible page; row = new page
+EV_ACK = 0x05        # key acknowledged on-device; row = slot in page, col = frame seq after it
+EV_PER_REPORT = 5
+EV_LOST = 0x80       # count flag: firmware queue overflowed
+CMD_NO_ACK = 0x40  # OR'd into commands 0x01-0x3F: firmware sends no reply
+
+# 0x16 reply, uint16 each. The render times are converted to µs for the dashboard.
+PERF_FIELDS = ("rx", "tx", "invalid", "stale", "events_lost", "render_max", "render_last", "ticks_per_ms")
+
+# Optional firmware features, a bitmask in ping reply byte 4 (config.h RAW_HID_*_ENABLE)
+FEAT_FADE = 0x01        # 0x11 crossfades
+FEAT_STATUS_BAR = 0x02  # UG_MODE_STATUS
+FEAT_PERF = 0x04        # 0x15 echo, 0x16 perf counters
+FEAT_PALETTE = 0x08     # 0x12 palette, 0x13 indexed frames
+
+# Underglow mode byte for commit_frame()
+UG_MODE_KEEP = 0
+UG_MODE_STATIC = 1
+UG_MODE_BREATHE = 2
+UG_MODE_STATUS = 3   # bar of waiting sessions drawn on-device, breathing when none
+
+# Per-LED effect modes for set_effect()
+FX_NONE = 0
+FX_SINE = 1
+FX_TRIANGLE = 2
+FX_GAMMA = 0x80  # mode flag: gamma-eased ramp
 
 
 # === Session tracking ===
 
 class Session:
-    __slots__ = ("session_id", "iterm_session", "state", "slot", "last_event_time")
+    __slots__ = ("session_id", "iterm_session", "state", "slot", "last_event_time", "last_event_at")
 
     def __init__(self, session_id, iterm_session, slot):
         self.session_id = session_id
         self.iterm_session = iterm_session
-        self.state = "working"  # "your_turn", "acknowledged", or "working"
+        self.state = "working"  # one of SESSION_STATES; change via SessionManager.set_state()
         self.slot = slot
         self.last_event_time = time.monotonic()
+        self.last_event_at = time.time()  # wall clock, for dashboard clients
 
 
 class SessionManager:
-    def __init__(self):
-        self.sessions = {}       # session_id → Session
-        self.slot_used = [False] * MAX_SLOTS
+    """Sessions plus lookup structures that are kept current on every change.
+
+    sessions is ordered oldest event first, so dimmed and releasable
+    sessions are always a prefix of it. slots maps slot → Session,
+    by_state maps state → session ids and dimmed holds the ids past
+    DIM_TIMEOUT, so the main loop never scans or rebuilds a set.
+
+    With a slot_file, assignments are saved on every slot change (and
+    timestamps/states on flush()) and restored at startup, so sessions
+    keep their key across daemon restarts.
+    """
+
+    def __init__(self, slot_file=None):
+        self.sessions = OrderedDict()   # session_id → Session, oldest event first
+        self.slots = [None] * MAX_SLOTS
+        self.by_state = {state: set() for state in SESSION_STATES}
+        self.dimmed = set()
+        self._free = list(range(MAX_SLOTS))  # min-heap of free slots
+        self._dimmed_changed = False
+        self._slot_file = slot_file
+        self._unsaved = False
+        if slot_file:
+            self._load()
+
+    @property
+    def slots_used(self):
+        return len(self.sessions)
 
     def get_or_create(self, session_id, iterm_session=None):
-        if session_id in self.sessions:
-            sess = self.sessions[session_id]
+        sess = self.sessions.get(session_id)
+        if sess:
             # Update iterm_session if we get a better one
             if iterm_session and not sess.iterm_session:
                 sess.iterm_session = iterm_session
-            sess.last_event_time = time.monotonic()
+            self._touch(sess)
             return sess
 
-        slot = self._next_slot()
-        if slot is None:
+        if not self._free:
             return None  # all slots full
 
-        sess = Session(session_id, iterm_session, slot)
-        self.sessions[session_id] = sess
-        self.slot_used[slot] = True
+        sess = Session(session_id, iterm_session, heapq.heappop(self._free))
+        self._add(sess)
+        self.save()
         return sess
 
-    def _next_slot(self):
-        for i, used in enumerate(self.slot_used):
-            if not used:
-                return i
-        return None
-
-    def release(self, session_id):
+    def _add(self, sess):
+        self.sessions[sess.session_id] = sess
+        self.slots[sess.slot] = sess
+        self.by_state[sess.state].add(sess.session_id)
+
+    def _touch(self, sess):
+        sess.last_event_time = time.monotonic()
+        sess.last_event_at = time.time()
+        self.sessions.move_to_end(sess.session_id)
+        if sess.session_id in self.dimmed:
+            self.dimmed.discard(sess.session_id)
+            self._dimmed_changed = True
+        self._unsaved = True
+
+    def set_state(self, sess, state):
+        """Move sess to state, keeping by_state current. Returns True if it changed."""
+        if sess.state == state:
+            return False
+        self.by_state[sess.state].discard(sess.session_id)
+        self.by_state[state].add(sess.session_id)
+        sess.state = state
+        self._unsaved = True
+        return True
+
+    def _release(self, session_id):
         sess = self.sessions.pop(session_id, None)
         if sess:
-            self.slot_used[sess.slot] = False
+            self.slots[sess.slot] = None
+            heapq.heappush(self._free, sess.slot)
+            self.by_state[sess.state].discard(session_id)
+            self.dimmed.discard(session_id)
+        return sess
+
+    def release(self, session_id):
+        if self._release(session_id):
+            self.save()
 
     def get_by_slot(self, slot):
-        for sess in self.sessions.values():
-            if sess.slot == slot:
-                return sess
-        return None
+        return self.slots[slot] if 0 <= slot < MAX_SLOTS else None
 
     def any_your_turn(self):
-        return any(s.state == "your_turn" for s in self.sessions.values())
+        return bool(self.by_state["your_turn"])
 
     def all_working(self):
-        return bool(self.sessions) and all(
-            s.state == "working" for s in self.sessions.values()
-        )
+        return bool(self.sessions) and len(self.by_state["working"]) == len(self.sessions)
 
     def cleanup_stale(self):
         """Release slots for sessions with no recent events."""
         now = time.monotonic()
-        stale = [
-            sid for sid, s in self.sessions.items()
-            if now - s.last_event_time > RELEASE_TIMEOUT
-        ]
+        stale = []
+        for sid, s in self.sessions.items():  # oldest first
+            if now - s.last_event_time <= RELEASE_TIMEOUT:
+                break
+            stale.append(sid)
         for sid in stale:
-            self.release(sid)
+            self._release(sid)
+        if stale:
+            self.save()
         return stale
 
-    def get_dimmed(self):
-        """Return sessions that should be dimmed (no events for DIM_TIMEOUT)."""
+    def refresh_dimmed(self):
+        """Move sessions that crossed DIM_TIMEOUT into dimmed.
+
+        Returns True if dimmed changed since the last call, including
+        sessions an event brought back.
+        """
         now = time.monotonic()
-        return [
-            s for s in self.sessions.values()
-            if now - s.last_event_time > DIM_TIMEOUT
-        ]
+        changed, self._dimmed_changed = self._dimmed_changed, False
+        for sid, s in self.sessions.items():  # dimmed sessions are a prefix
+            if now - s.last_event_time <= DIM_TIMEOUT:
+                break
+            if sid not in self.dimmed:
+                self.dimmed.add(sid)
+                changed = True
+        return changed
+
+    def next_dim_time(self):
+        """Monotonic time the next not-yet-dimmed session goes stale, or None."""
+        for s in self.sessions.values():
+            if s.session_id not in self.dimmed:
+                return s.last_event_time + DIM_TIMEOUT
+        return None
+
+    # --- Persistence ---
+
+    def save(self):
+        if not self._slot_file:
+            return
+        data = {"sessions": [
+            {"session_id": s.session_id, "slot": s.slot, "state": s.state,
+             "iterm_session": s.iterm_session or "", "last_event_at": s.last_event_at}
+            for s in self.sessions.values()
+        ]}
+        tmp = f"{self._slot_file}.tmp"
+        try:
+            with open(tmp, "w") as f:
+                json.dump(data, f)
+            os.replace(tmp, self._slot_file)
+            self._unsaved = False
+        except OSError:
+            pass
+
+    def flush(self):
+        """Save refreshed timestamps and states; slot changes are saved at once."""
+        if self._unsaved:
+            self.save()
+
+    def _load(self):
+        try:
+            with open(self._slot_file) as f:
+                entries = json.load(f)["sessions"]
+        except (OSError, ValueError, KeyError, TypeError):
+            return
+        now, wall = time.monotonic(), time.time()
+        for e in sorted(entries, key=lambda e: e.get("last_event_at", 0)):
+            try:
+                slot, age = e["slot"], wall - e["last_event_at"]
+                sid, state = e["session_id"], e["state"]
+            except (KeyError, TypeError):
+                continue
+            if (not 0 <= slot < MAX_SLOTS or self.slots[slot] or sid in self.sessions
+                    or state not in self.by_state or age > RELEASE_TIMEOUT):
+                continue
+            sess = Session(sid, e.get("iterm_session") or None, slot)
+            sess.state = state
+            sess.last_event_time = now - max(0, age)
+            sess.last_event_at = e["last_event_at"]
+            self._add(sess)
+        self._free = [i for i in range(MAX_SLOTS) if self.slots[i] is None]
+        heapq.heapify(self._free)
+        self.refresh_dimmed()
+        self._dimmed_changed = False
+
+
+class KeyEvent:
+    """Event from the firmware queue; t is the event time on our monotonic clock.
+
+    For EV_ENCODER, row is the encoder index and col the signed tick delta
+    accumulated since the previous report (clockwise positive). page is the
+    page that was visible on the keys at the time.
+    """
+    __slots__ = ("type", "row", "col", "t", "page")
+
+    def __init__(self, type, row, col, t, page=0):
+        self.type = type
+        self.row = row
+        self.col = col
+        self.t = t
+        self.page = page
+
+
+def parse_event_report(raw, t_rx):
+    """Decode a 0xEE report into KeyEvents. Returns (events, lost)."""
+    count = raw[1] & ~EV_LOST & 0xFF
+    fw_now = raw[2] | (raw[3] << 8)
+    events = []
+    for i in range(min(count, EV_PER_REPORT)):
+        rec = raw[4 + i * 5:9 + i * 5]
+        age_ms = (fw_now - (rec[3] | (rec[4] << 8))) & 0xFFFF
+        etype, page = rec[0] & 0x0F, rec[0] >> 4
+        col = rec[2] - 256 if etype == EV_ENCODER and rec[2] > 127 else rec[2]
+        events.append(KeyEvent(etype, rec[1], col, t_rx - age_ms / 1000, page))
+    return events, bool(raw[1] & EV_LOST)
+
+
+# === Main loop wakeup ===
+
+class Waker:
+    """Self-pipe the main loop sleeps on; set() from any thread wakes it."""
+
+    def __init__(self):
+        self._r, self._w = os.pipe()
+        os.set_blocking(self._r, False)
+        os.set_blocking(self._w, False)
+
+    def fileno(self):
+        return self._r
+
+    def set(self):
+        try:
+            os.write(self._w, b"\x00")
+        except BlockingIOError:
+            pass  # pipe full: a wakeup is already pending
+
+    def clear(self):
+        try:
+            while os.read(self._r, 512):
+                pass
+        except BlockingIOError:
+            pass
+
+
+# === Frame model ===
+
+class Frame:
+    """Keyboard image of one page: per-LED HSV and effect, blink mask, underglow.
+
+    keyboard_image() builds the desired Frames; RawHIDProtocol keeps others
+    mirroring what the firmware holds and sends only the difference.
+    effects[i] is None (static) or (mode, period_ms, min_v, max_v, phase).
+    Only the session keys differ per page: the other LEDs are shared, so
+    every page's Frame must agree on them, and only page 0 sets underglow.
+    """
+    __slots__ = ("page", "leds", "effects", "blink_mask", "ug_mode", "ug_hsv")
+
+    def __init__(self, page=0):
+        self.page = page
+        self.leds = [(0, 0, 0)] * NUM_LEDS
+        self.effects = [None] * NUM_LEDS
+        self.blink_mask = 0
+        self.ug_mode = UG_MODE_KEEP
+        self.ug_hsv = (0, 0, 0)
+
+    def copy(self):
+        f = Frame(self.page)
+        f.leds = list(self.leds)
+        f.effects = list(self.effects)
+        f.blink_mask = self.blink_mask
+        f.ug_mode = self.ug_mode
+        f.ug_hsv = self.ug_hsv
+        return f
+
+    def effect_groups(self):
+        """{effect: led mask} for every distinct effect (None = static)."""
+        groups = {}
+        for i, fx in enumerate(self.effects):
+            groups[fx] = groups.get(fx, 0) | (1 << i)
+        return groups
+
+
+# Everything the keyboard should show: one Frame per page in use, and the
+# slot state codes (SLOT_STATE_CODES) of each page's 8 keys
+KeyboardImage = namedtuple("KeyboardImage", "frames states")
+
+
+def _same_color(a, b):
+    # Unlit LEDs match whatever hue/sat they carry
+    return a == b or (a[2] == 0 and b[2] == 0)
 
 
 # === Protocol abstraction ===
 
 class KeyboardProtocol:
+    pages = 1      # LED pages the keyboard can hold; only RawHIDProtocol has more
+    view_page = 0  # page the keyboard is showing
+    acks_locally = False  # firmware acknowledges your-turn keys itself (EV_ACK)
+    perf = None    # latest firmware perf counters (dict), if the firmware has them
+    resync_needed = False  # keepalive() found the keyboard's state replaced: replay the image
+    on_reset = None  # called from the reader thread when a reply shows the state was replaced
+
     def connect(self):
         raise NotImplementedError
 
     def enter_direct_mode(self):
         raise NotImplementedError
 
-    def set_led(self, idx, h, s, v):
+    def set_led(self, idx, h, s, v, ack=True):
+        """ack=False sends fire-and-forget (no reply, no blocking read)."""
         raise NotImplementedError
 
     def set_all_leds(self, h, s, v):
@@ -201,92 +502,308 @@ class KeyboardProtocol:
     def set_underglow_breathe(self, h, s, v):
         raise NotImplementedError
 
+    def commit_frame(self, h, s, values, blink_mask=0, ug_mode=UG_MODE_KEEP, ug_hsv=(0, 0, 0), page=0):
+        """Replace every LED (shared h/s, per-LED v), blink mask and underglow at once."""
+        raise NotImplementedError
+
+    def set_effect(self, mask, mode, period_ms=0, min_v=0, max_v=0, phase=0, page=0):
+        """Animate V of every LED in mask on-device (hue/sat come from the LED buffer)."""
+        raise NotImplementedError
+
+    def set_page_count(self, count):
+        """Number of pages in use; a no-op for single-page keyboards."""
+
+    def set_slot_states(self, page, states):
+        """Session state codes (SLOT_STATE_CODES) of a page's 8 keys, for on-device acks."""
+
+    def note_local_ack(self, page, slot, seq):
+        """The firmware acknowledged a key itself (EV_ACK); account for its LED change."""
+
+    def acks_slot(self, page, slot):
+        """True if a press of this key is acknowledged on-device (the firmware holds it as your-turn)."""
+        return False
+
+    def forget_page(self, page):
+        """Drop what's cached about a page, so the next apply() resends all of it."""
+
+    def set_palette(self, colors):
+        """Upload the colors indexed frames can use; a no-op without palette support."""
+
+    def apply(self, image):
+        """Bring the keyboard to a KeyboardImage. Pages it can't hold are skipped."""
+        self.set_page_count(len(image.frames))
+        for frame in image.frames:
+            self.show(frame)
+            self.set_slot_states(frame.page, image.states[frame.page])  # after the look it acks from
+
+    def replay(self, image):
+        """Upload a whole image to a keyboard that was just connected."""
+        self.apply(image)
+
+    def show(self, frame):
+        """Push a Frame. The default sends it in full; subclasses may diff."""
+        if frame.page >= self.pages:
+            return
+        lit = [c for c in frame.leds if c[2]]
+        h, s = lit[0][:2] if lit else (0, 0)
+        self.commit_frame(h, s, [c[2] for c in frame.leds], frame.blink_mask,
+                          frame.ug_mode, frame.ug_hsv)
+        for fx, mask in frame.effect_groups().items():
+            if fx:
+                self.set_effect(mask, *fx)
+
     def restore_effect(self):
         raise NotImplementedError
 
     def poll_key_event(self):
-        """Non-blocking read for 0xEE key events. Returns (row, col) or None."""
+        """Non-blocking read for 0xEE key events. Returns a KeyEvent or None."""
         raise NotImplementedError
 
     def ping(self):
         """Returns True if keyboard is still connected."""
         raise NotImplementedError
 
+    @property
+    def connected(self):
+        """False once the transport has noticed the device is gone."""
+        return True
+
+    def keepalive(self):
+        """Called every HEARTBEAT_INTERVAL from the board's worker. Returns
+        False if the keyboard is gone; sets resync_needed if it lost state."""
+        return self.ping()
+
+    def disarm(self):
+        """Turn the firmware watchdog off (clean exit: nothing will feed it)."""
+
+    def poll_perf(self):
+        """Refresh perf without blocking; called with the keepalive."""
+
     def close(self):
         raise NotImplementedError
 
 
-class RawHIDProtocol(KeyboardProtocol):
-    def __init__(self):
-        self.dev = None
+class PendingReply:
+    """One in-flight tagged request; wait() blocks until its reply or deadline."""
+    __slots__ = ("cmd", "deadline", "reply", "_event", "_cancel")
 
-    def connect(self):
-        for desc in hid.enumerate(WL_VID, WL_PID):
-            if desc["usage_page"] == RAW_HID_USAGE_PAGE and desc["usage"] == RAW_HID_USAGE:
-                try:
-                    dev = hid.device()
-                    dev.open_path(desc["path"])
-                    self.dev = dev
-                except OSError:
-                    continue
-                resp = self._send(bytes([0xF0]))
-                if resp and resp[0] == 0xF0 and resp[1] == 0x01:
-                    led_count = resp[2]
-                    print(f"Raw HID connected ({led_count} LEDs)")
-                    return True
-                self.dev.close()
-                self.dev = None
-        return False
+    def __init__(self, cmd, deadline):
+        self.cmd = cmd
+        self.deadline = deadline
+        self.reply = None
+        self._event = threading.Event()
+        self._cancel = None
 
-    def _send(self, msg):
-        """Send a command and read until we get a matching response.
+    def done(self, reply):
+        self.reply = reply
+        self._event.set()
 
-        Stashes any 0xEE key events received while waiting.
-        """
-        if not self.dev:
-            return None
-        padded = msg + b"\x00" * (MSG_LEN - len(msg))
-        try:
-            self.dev.write(b"\x00" + padded)
-        except OSError:
-            return None
-        return self._read_response(msg[0])
+    def ready(self):
+        """True once wait() would return without blocking."""
+        return self._event.is_set() or time.monotonic() >= self.deadline
 
-    def _read_response(self, expected_cmd, timeout_ms=500):
-        """Read HID reports until we get one matching expected_cmd.
+    def wait(self):
+        if not self._event.wait(max(0, self.deadline - time.monotonic())):
+            if self._cancel:
+                self._cancel()
+        return self.reply
 
-        Any 0xEE key events received in the meantime are stashed
-        in self._pending_keys for later polling.
-        """
-        if not hasattr(self, "_pending_keys"):
-            self._pending_keys = []
-        deadline = time.monotonic() + timeout_ms / 1000
-        while time.monotonic() < deadline:
-            remaining = max(1, int((deadline - time.monotonic()) * 1000))
+
+def _raw_hid_descs():
+    return [d for d in hid.enumerate(WL_VID, WL_PID)
+            if d["usage_page"] == RAW_HID_USAGE_PAGE and d["usage"] == RAW_HID_USAGE]
+
+
+def raw_hid_paths():
+    """HID paths of the Raw HID interface of every attached board."""
+    return [d["path"] for d in _raw_hid_descs()]
+
+
+def raw_hid_boards():
+    """{board key: HID path} for every attached board.
+
+    The key is the USB serial number, which survives a replug (macOS
+    paths don't: they carry the IORegistry id). Boards that share or
+    lack a serial fall back to their path.
+    """
+    descs = _raw_hid_descs()
+    serials = [d.get("serial_number") or "" for d in descs]
+    return {(sn if sn and serials.count(sn) == 1 else d["path"]): d["path"]
+            for d, sn in zip(descs, serials)}
+
+
+class RawHIDProtocol(KeyboardProtocol):
+    """Raw HID transport with pipelining.
+
+    Every request carries a tag in byte 31 that the firmware echoes, so
+    several requests can be in flight at once and each has its own
+    deadline: a lost reply only costs that one request.
+    """
+    STATUS_OK = 0x01
+    STATUS_STALE = 0xFE
+    HOST_FLAGS_BYTE = MSG_LEN - 2  # 0x0E flags, in every reply
+    TAG_BYTE = MSG_LEN - 1
+    REQUEST_TIMEOUT = 0.5  # seconds
+
+    def __init__(self, on_wake=None):
+        self.dev = None
+        self._mirrors = {}   # page → Frame the firmware holds; missing = unknown
+        self._seq = 0        # firmware frame_seq matching _mirrors (one counter for all pages)
+        self.pages = 1       # LED pages the firmware holds (from ping)
+        self.features = 0    # FEAT_* the firmware was built with (from ping)
+        self._page_count = None  # pages in use, as last sent with 0x0F
+        self._slot_states = {}   # page → state codes the firmware holds (0x10)
+        self._palette = {}       # HSV → firmware palette index (0x12)
+        self._perf_req = None    # outstanding 0x16, collected on the next poll_perf()
+        self._on_wake = on_wake         # called from the reader thread on 0xEE and on unplug
+        self._lost = False              # set by the reader thread when reads fail
+        self._reset_seen = False        # a reply showed WD_RESET; cleared by the next keepalive()
+        self._keys = deque()            # KeyEvents from the reader thread
+        self._pending = {}              # tag → PendingReply
+        self._next_tag = 1
+        self._lock = threading.Lock()   # guards _pending, _next_tag and writes
+        self._reader = None
+        self._stop = threading.Event()
+
+    def connect(self, path=None):
+        """Open the board at path (a raw_hid_paths() entry), or the first one that answers."""
+        for candidate in raw_hid_paths() if path is None else [path]:
             try:
-                data = self.dev.read(MSG_LEN, timeout_ms=remaining)
+                dev = hid.device()
+                dev.open_path(candidate)
+                self.dev = dev
             except OSError:
-                return None
+                continue
+            self._start_reader()
+            resp = self._send(bytes([0xF0]))
+            if resp and resp[0] == 0xF0 and resp[1] == 0x01:
+                led_count = resp[2]
+                self.pages = max(1, resp[3])  # 0 from firmware without pages
+                self.features = resp[4]
+                print(f"Raw HID connected ({led_count} LEDs, {self.pages} pages, features 0x{self.features:02x})")
+                self._post(struct.pack("<BH", 0x0E, WATCHDOG_TIMEOUT_MS))  # arm the firmware watchdog
+                self._reset_seen = False  # a leftover reset is covered by the replay after connect
+                if self.features & FEAT_FADE:
+                    self._post(struct.pack("<BH", 0x11, FADE_MS))
+                if self.features & FEAT_PALETTE:
+                    self.set_palette(PALETTE)
+                return True
+            self.close()
+        return False
+
+    def _start_reader(self):
+        self._stop.clear()
+        self._lost = False
+        self._reader = threading.Thread(target=self._read_loop, args=(self.dev,), daemon=True)
+        self._reader.start()
+
+    def _read_loop(self, dev):
+        """Reader thread: owns every dev.read(), routes replies to their request by tag."""
+        while not self._stop.is_set():
+            try:
+                data = dev.read(MSG_LEN, timeout_ms=100)
+            except OSError:
+                # Unplugged: hidapi fails the read on removal. Tell the main
+                # loop right away instead of waiting for a heartbeat.
+                self._lost = True
+                if self._on_wake:
+                    self._on_wake()
+                break
             if not data:
                 continue
             raw = bytes(data)
             if raw[0] == CMD_KEY_EVENT:
-                self._pending_keys.append((raw[1], raw[2]))
+                events, lost = parse_event_report(raw, time.monotonic())
+                if lost:
+                    print("  Keyboard event queue overflowed; some key events were lost")
+                self._keys.extend(events)
+                if self._on_wake:
+                    self._on_wake()
                 continue
-            if raw[0] == expected_cmd:
-                return raw
+            if raw[self.HOST_FLAGS_BYTE] & self.WD_RESET and not self._reset_seen:
+                # The watchdog fired while we were away (and maybe got cancelled
+                # by this very command): have the worker check now, not at the
+                # next heartbeat
+                self._reset_seen = True
+                if self.on_reset:
+                    self.on_reset()
+            with self._lock:
+                req = self._pending.pop(raw[self.TAG_BYTE], None)
+            if req:  # no match: late reply to a request that already timed out
+                req.done(raw if raw[0] == req.cmd else None)
+        with self._lock:
+            pending, self._pending = self._pending, {}
+        for req in pending.values():  # device gone: fail everything in flight
+            req.done(None)
+
+    def submit(self, msg, timeout=None):
+        """Write a tagged request and return its PendingReply without waiting."""
+        req = PendingReply(msg[0], time.monotonic() + (timeout or self.REQUEST_TIMEOUT))
+        if not self.dev:
+            req.done(None)
+            return req
+        padded = msg + b"\x00" * (self.TAG_BYTE - len(msg))
+        with self._lock:
+            tag = self._alloc_tag()
+            if tag is None:
+                req.done(None)
+                return req
+            self._pending[tag] = req
+            req._cancel = lambda: self._cancel(tag, req)
+            try:
+                self.dev.write(b"\x00" + padded + bytes([tag]))
+            except OSError:
+                del self._pending[tag]
+                req.done(None)
+        return req
+
+    def _alloc_tag(self):
+        for _ in range(255):
+            tag = self._next_tag
+            self._next_tag = tag % 255 + 1  # 1..255; 0 means untagged
+            if tag not in self._pending:
+                return tag
         return None
 
+    def _cancel(self, tag, req):
+        with self._lock:
+            if self._pending.get(tag) is req:
+                del self._pending[tag]
+
+    def _send(self, msg):
+        """Send a command and wait for its reply (None on timeout)."""
+        return self.submit(msg).wait()
+
+    def _post(self, msg):
+        """Send a command with the no-ack flag set. Never blocks on a reply."""
+        if not self.dev:
+            return
+        padded = bytes([msg[0] | CMD_NO_ACK]) + msg[1:] + b"\x00" * (MSG_LEN - len(msg))
+        with self._lock:
+            try:
+                self.dev.write(b"\x00" + padded)
+            except OSError:
+                pass
+
     def enter_direct_mode(self):
+        self._mirrors = {}
+        self._slot_states = {}
         self._send(bytes([0x05]))
 
-    def set_led(self, idx, h, s, v):
-        self._send(bytes([0x01, idx, h, s, v]))
+    def set_led(self, idx, h, s, v, ack=True):
+        self._mirrors = {}
+        msg = bytes([0x01, idx, h, s, v])
+        if ack:
+            self._send(msg)
+        else:
+            self._post(msg)
 
     def set_all_leds(self, h, s, v):
+        self._mirrors = {}
         self._send(bytes([0x04, h, s, v]))
 
     def set_blink(self, idx, enable):
+        self._mirrors = {}
         self._send(bytes([0x07, idx, 1 if enable else 0]))
 
     def set_underglow(self, h, s, v):
@@ -295,35 +812,338 @@ class RawHIDProtocol(KeyboardProtocol):
     def set_underglow_breathe(self, h, s, v):
         self._send(bytes([0x0A, h, s, v]))
 
+    def commit_frame(self, h, s, values, blink_mask=0, ug_mode=UG_MODE_KEEP, ug_hsv=(0, 0, 0), page=0):
+        """Returns the firmware frame seq after the commit, or None."""
+        self._mirrors = {}
+        resp = self._send(self._commit_msg(h, s, values, blink_mask, ug_mode, ug_hsv, page))
+        return resp[2] if resp and resp[1] == self.STATUS_OK else None
+
+    @staticmethod
+    def _commit_msg(h, s, values, blink_mask, ug_mode, ug_hsv, page):
+        msg = bytes([0x0B, h, s]) + bytes(values[:NUM_LEDS])
+        msg += struct.pack("<H", blink_mask)
+        return msg + bytes([ug_mode, *ug_hsv, page])
+
+    def set_effect(self, mask, mode, period_ms=0, min_v=0, max_v=0, phase=0, page=0):
+        msg = struct.pack("<BHBHBBB", 0x0C, mask | page << NUM_LEDS, mode, period_ms, min_v, max_v, phase)
+        resp = self._send(msg)
+        return resp is not None and resp[1] == self.STATUS_OK
+
+    def set_page_count(self, count):
+        """Tell the firmware how many pages are in use (it flips between them)."""
+        count = max(1, min(count, self.pages))
+        if count != self._page_count:
+            resp = self._send(bytes([0x0F, count]))
+            if resp and resp[1] == self.STATUS_OK:
+                self._page_count = count
+                self.view_page = resp[2]  # clamped if it was past the new count
+
+    def set_slot_states(self, page, states):
+        states = bytes(states)
+        if page < self.pages and self._slot_states.get(page) != states:
+            resp = self._send(bytes([0x10, page]) + states)
+            self.acks_locally = bool(resp and resp[1] == self.STATUS_OK)
+            if self.acks_locally:
+                self._slot_states[page] = states
+
+    def note_local_ack(self, page, slot, seq):
+        """Apply the firmware's acknowledge to the page mirror: the effect
+        stops and the LED holds its max_v. If other writes got in between
+        (seq doesn't follow ours) the page is resynced on the next show()."""
+        states = self._slot_states.get(page)
+        if states:
+            self._slot_states[page] = states[:slot] + bytes([SLOT_STATE_CODES["acknowledged"]]) + states[slot + 1:]
+        m = self._mirrors.get(page)
+        if m is None or seq != (self._seq + 1) & 0xFF:
+            self._mirrors.pop(page, None)
+            return
+        led = SLOT_LEDS[slot]
+        if m.effects[led]:
+            m.leds[led] = m.leds[led][:2] + (m.effects[led][3],)
+            m.effects[led] = None
+        self._seq = seq
+
+    def acks_slot(self, page, slot):
+        states = self._slot_states.get(page)
+        return self.acks_locally and states is not None and states[slot] == SLOT_STATE_CODES["your_turn"]
+
+    def forget_page(self, page):
+        self._mirrors.pop(page, None)
+        self._slot_states.pop(page, None)
+
+    def set_palette(self, colors):
+        """Upload colors (at most PALETTE_SIZE) in 0x12 batches of 9.
+
+        The firmware re-colors LEDs that follow a changed entry and bumps
+        its seq, so the mirrors are dropped and the next show() recommits.
+        """
+        colors = colors[:PALETTE_SIZE]
+        self._palette = {}
+        self._mirrors = {}
+        batches = [self.submit(bytes([0x12, start, len(batch)]) + bytes(v for c in batch for v in c))
+                   for start in range(0, len(colors), 9)
+                   for batch in [colors[start:start + 9]]]
+        for req in batches:
+            resp = req.wait()
+            if not resp or resp[1] != self.STATUS_OK:
+                return False  # indexed frames stay off
+        self._palette = {c: i for i, c in reversed(list(enumerate(colors)))}
+        return True
+
+    def _indexes(self, leds):
+        """Palette index per LED, or None if any color isn't in the palette."""
+        black = self._palette.get((0, 0, 0))
+        idx = [self._palette.get(c) if c[2] else black for c in leds]
+        return None if None in idx else idx
+
+    def show(self, frame):
+        """Send only what differs from the firmware's current frame.
+
+        LED colors go out as one seq-checked 0x13 indexed frame when every
+        color is in the palette, else as 0x0D deltas; effects are diffed
+        per LED; all of them are pipelined back-to-back. A stale seq or a
+        lost reply falls back to one full commit of that page.
+        """
+        if frame.page >= self.pages:
+            return
+        m = self._mirrors.get(frame.page)
+        if (m is None or m.blink_mask != frame.blink_mask
+                or (frame.ug_mode != UG_MODE_KEEP
+                    and (frame.ug_mode, frame.ug_hsv) != (m.ug_mode, m.ug_hsv))):
+            if not self._commit(frame):
+                return
+        if not self._push(frame):
+            if not self._commit(frame) or not self._push(frame):
+                self._mirrors.pop(frame.page, None)
+
+    def _sync_shared(self, m):
+        """Shared LEDs are one set of firmware state: copy m's to every page mirror."""
+        for other in self._mirrors.values():
+            if other is not m:
+                for i in SHARED_LEDS:
+                    other.leds[i] = m.leds[i]
+                    other.effects[i] = m.effects[i]
+
+    def _commit_plan(self, frame):
+        """Full commit using the first lit LED's hue/sat; mismatches are left to deltas.
+        Returns the 0x0B message and the Frame the firmware holds once it's applied.
+        Firmware without the status bar breathes the underglow instead."""
+        lit = [c for c in frame.leds if c[2]]
+        h, s = lit[0][:2] if lit else (0, 0)
+        values = [c[2] if c[:2] == (h, s) else 0 for c in frame.leds]
+        mirror = Frame(frame.page)
+        mirror.leds = [(h, s, v) for v in values]
+        mirror.blink_mask = frame.blink_mask
+        mirror.ug_mode = frame.ug_mode
+        mirror.ug_hsv = frame.ug_hsv
+        ug_mode = frame.ug_mode
+        if ug_mode == UG_MODE_STATUS and not self.features & FEAT_STATUS_BAR:
+            ug_mode = UG_MODE_BREATHE
+        msg = self._commit_msg(h, s, values, frame.blink_mask, ug_mode, frame.ug_hsv, frame.page)
+        return msg, mirror
+
+    def _commit(self, frame):
+        msg, mirror = self._commit_plan(frame)
+        resp = self._send(msg)  # other pages' mirrors survive a commit of this one
+        if not resp or resp[1] != self.STATUS_OK:
+            self._mirrors = {}
+            return False
+        self._mirrors[frame.page] = mirror
+        self._seq = resp[2]
+        self._sync_shared(mirror)
+        return True
+
+    def replay(self, image):
+        """Upload a whole image right after connect as one pipelined batch.
+
+        The page count, one commit per page, its effect groups and its slot
+        states all go out back-to-back and are collected together, so the
+        keyboard is correct one round trip after the ping. apply() then
+        resends only what didn't land (normally nothing).
+        """
+        frames = [f for f in image.frames if f.page < self.pages]
+        count = max(1, len(frames))
+        inflight = []  # (PendingReply, apply callback)
+
+        def apply_count(resp):
+            self._page_count = count
+            self.view_page = resp[2]
+        inflight.append((self.submit(bytes([0x0F, count])), apply_count))
+
+        for frame in frames:
+            msg, mirror = self._commit_plan(frame)
+
+            def apply_commit(resp, mirror=mirror):
+                self._mirrors[mirror.page] = mirror
+                self._seq = resp[2]
+                self._sync_shared(mirror)
+            inflight.append((self.submit(msg), apply_commit))
+
+            # A commit clears every effect, so only the animated groups follow it
+            for fx, mask in frame.effect_groups().items():
+                if fx is None:
+                    continue
+                msg = struct.pack("<BHBHBBB", 0x0C, mask | frame.page << NUM_LEDS, *fx)
+
+                def apply_fx(resp, fx=fx, mask=mask, page=frame.page):
+                    m = self._mirrors.get(page)
+                    if m is not None:
+                        for i in range(NUM_LEDS):
+                            if mask & (1 << i):
+                                m.effects[i] = fx
+                inflight.append((self.submit(msg), apply_fx))
+
+            states = bytes(image.states[frame.page])
+
+            def apply_states(resp, page=frame.page, states=states):
+                self.acks_locally = True
+                self._slot_states[page] = states
+            inflight.append((self.submit(bytes([0x10, frame.page]) + states), apply_states))
+
+        for req, apply in inflight:
+            resp = req.wait()
+            if resp and resp[1] == self.STATUS_OK:
+                apply(resp)
+        self.apply(image)
+
+    def _push(self, frame):
+        """Pipeline deltas and effect changes, then settle the mirror.
+
+        Each applied delta bumps the firmware seq by one, so later deltas
+        are submitted against the predicted seq without waiting. Returns
+        False if anything was rejected or lost.
+        """
+        m = self._mirrors[frame.page]
+        addr = frame.page << 4  # page nibble of the LED address
+        inflight = []  # (PendingReply, apply callback)
+
+        changed = [i for i in range(NUM_LEDS) if not _same_color(frame.leds[i], m.leds[i])]
+        seq = self._seq
+        idx = self._indexes(frame.leds) if changed else None
+        if idx is not None:
+            # Whole page in one report, LEDs stay linked to the palette
+            msg = bytes([0x13, seq, frame.page]) + bytes(a | b << 4 for a, b in zip(idx[::2], idx[1::2]))
+            colors = {i: c for c, i in self._palette.items()}
+
+            def apply(resp):
+                self._seq = resp[2]
+                m.leds[:] = [colors[i] for i in idx]
+            inflight.append((self.submit(msg), apply))
+        elif changed:
+            first, last = changed[0], changed[-1]
+            for start in range(first, last + 1, 9):
+                count = min(9, last + 1 - start)
+                msg = bytes([0x0D, seq, addr | start, count])
+                for c in frame.leds[start:start + count]:
+                    msg += bytes(c)
+                seq = (seq + 1) & 0xFF
+
+                def apply(resp, start=start, count=count):
+                    self._seq = resp[2]
+                    m.leds[start:start + count] = frame.leds[start:start + count]
+                inflight.append((self.submit(msg), apply))
+
+        groups = {}
+        for i in range(NUM_LEDS):
+            if frame.effects[i] != m.effects[i]:
+                groups[frame.effects[i]] = groups.get(frame.effects[i], 0) | (1 << i)
+        for fx, mask in groups.items():
+            msg = struct.pack("<BHBHBBB", 0x0C, mask | frame.page << NUM_LEDS,
+                              *(fx or (FX_NONE, 0, 0, 0, 0)))
+
+            def apply(resp, fx=fx, mask=mask):
+                for i in range(NUM_LEDS):
+                    if mask & (1 << i):
+                        m.effects[i] = fx
+            inflight.append((self.submit(msg), apply))
+
+        ok = True
+        for req, apply in inflight:
+            resp = req.wait()
+            if resp and resp[1] == self.STATUS_OK and ok:
+                apply(resp)
+            else:
+                ok = False  # stale base or lost reply: caller resyncs
+        self._sync_shared(m)
+        return ok
+
     def restore_effect(self):
+        self._mirrors = {}
+        self._slot_states = {}
         self._send(bytes([0x03]))
 
     def poll_key_event(self):
-        if not hasattr(self, "_pending_keys"):
-            self._pending_keys = []
-        # Check for stashed events first
-        if self._pending_keys:
-            return self._pending_keys.pop(0)
-        # Non-blocking read
-        if not self.dev:
-            return None
         try:
-            data = self.dev.read(MSG_LEN, timeout_ms=5)
-        except OSError:
+            key = self._keys.popleft()
+        except IndexError:
             return None
-        if data:
-            raw = bytes(data)
-            if raw[0] == CMD_KEY_EVENT:
-                return (raw[1], raw[2])
-        return None
+        if key.type == EV_PAGE:
+            self.view_page = key.row
+        return key
 
     def ping(self):
         resp = self._send(bytes([0xF0]))
         return resp is not None and resp[0] == 0xF0
 
+    @property
+    def connected(self):
+        return self.dev is not None and not self._lost
+
+    WD_DIRECT = 0x01  # 0x0E reply flags
+    WD_RESET = 0x02
+
+    def keepalive(self):
+        """Feed the firmware watchdog (0x0E) and check it still holds our state.
+
+        Runs on the board's worker, so waiting for the reply holds up no
+        one. If the firmware left direct mode or its watchdog replaced the
+        LEDs (it fired while we didn't look), the caches no longer describe
+        the keyboard: they are dropped and resync_needed asks for a replay.
+        Every reply carries the same flags in byte 30, so the reader
+        thread calls on_reset to get here early when one shows a reset.
+        Unplugs are detected by the reader thread, not here.
+        """
+        if not self.connected:
+            return False
+        resp = self._send(struct.pack("<BH", 0x0E, WATCHDOG_TIMEOUT_MS))
+        if resp and resp[1] == self.STATUS_OK:
+            self._reset_seen = False  # replies before this one were read first
+            flags = resp[2]
+            if not flags & self.WD_DIRECT or flags & self.WD_RESET:
+                self._mirrors = {}
+                self._slot_states = {}
+                self._page_count = None
+                self.resync_needed = True
+        return True
+
+    def disarm(self):
+        self._send(struct.pack("<BH", 0x0E, 0))
+
+    def poll_perf(self):
+        """Take the previous 0x16 reply, if any, and send the next request."""
+        if not self.features & FEAT_PERF:
+            return
+        req = self._perf_req
+        if req is not None:
+            if not req.ready():
+                return
+            resp = req.wait()  # returns at once; drops a lost request's tag
+            if resp and resp[1] == self.STATUS_OK:
+                perf = dict(zip(PERF_FIELDS, struct.unpack_from("<8H", resp, 2)))
+                per_ms = perf.pop("ticks_per_ms") or 1
+                perf["render_max_us"] = perf.pop("render_max") * 1000 // per_ms
+                perf["render_last_us"] = perf.pop("render_last") * 1000 // per_ms
+                self.perf = perf
+        self._perf_req = self.submit(bytes([0x16]))
+
     def close(self):
+        self._stop.set()
+        if self._reader:
+            self._reader.join(timeout=1)
+            self._reader = None
         if self.dev:
             self.dev.close()
+            self.dev = None
 
 
 class VialRGBProtocol(KeyboardProtocol):
@@ -340,6 +1160,13 @@ class VialRGBProtocol(KeyboardProtocol):
     def __init__(self):
         self.dev = None
 
+    @staticmethod
+    def present():
+        """True if a VIALRGB board is attached (enumeration only, no I/O)."""
+        return any(VIAL_SERIAL_MAGIC in (d.get("serial_number") or "")
+                   and d["usage_page"] == RAW_HID_USAGE_PAGE and d["usage"] == RAW_HID_USAGE
+                   for d in hid.enumerate())
+
     def connect(self):
         for desc in hid.enumerate():
             sn = desc.get("serial_number", "")
@@ -389,7 +1216,7 @@ class VialRGBProtocol(KeyboardProtocol):
                                self.VIALRGB_EFFECT_DIRECT,
                                128, 128, 128, 128))
 
-    def set_led(self, idx, h, s, v):
+    def set_led(self, idx, h, s, v, ack=True):
         payload = struct.pack("<BBHB", self.CMD_VIA_LIGHTING_SET_VALUE,
                               self.VIALRGB_DIRECT_FASTSET, idx, 1)
         payload += bytes([h, s, v])
@@ -413,6 +1240,18 @@ class VialRGBProtocol(KeyboardProtocol):
     def set_underglow_breathe(self, h, s, v):
         pass
 
+    def commit_frame(self, h, s, values, blink_mask=0, ug_mode=UG_MODE_KEEP, ug_hsv=(0, 0, 0), page=0):
+        for start in range(0, NUM_LEDS, 9):
+            batch = min(9, NUM_LEDS - start)
+            payload = struct.pack("<BBHB", self.CMD_VIA_LIGHTING_SET_VALUE,
+                                  self.VIALRGB_DIRECT_FASTSET, start, batch)
+            for v in values[start:start + batch]:
+                payload += bytes([h, s, v])
+            self._send(payload)
+
+    def set_effect(self, mask, mode, period_ms=0, min_v=0, max_v=0, phase=0, page=0):
+        pass  # VIALRGB doesn't support firmware-side effects
+
     def restore_effect(self):
         self._send(struct.pack("<BBHBBBB",
                                self.CMD_VIA_LIGHTING_SET_VALUE,
@@ -432,43 +1271,393 @@ class VialRGBProtocol(KeyboardProtocol):
 
 # === Event processing ===
 
-def read_new_events(pos):
-    if not STATE_FILE.exists():
-        return [], pos
-    size = STATE_FILE.stat().st_size
-    if size < pos:
-        pos = 0
-    if size == pos:
-        return [], pos
-    events = []
-    with open(STATE_FILE) as f:
-        f.seek(pos)
-        for line in f:
+POLL_INTERVAL = 0.05  # spool polling when file notifications are unavailable
+
+# Main loop deadlines (seconds). Between them the loop sleeps in select().
+HEARTBEAT_INTERVAL = 5       # keepalive; also feeds the firmware watchdog
+WATCHDOG_TIMEOUT_MS = 15000  # firmware shows "host lost" and restores after this much silence
+RECONNECT_INTERVAL = 3       # polling for the keyboard when there is no hotplug watch
+RECONNECT_FALLBACK = 30      # with one, in case a notification is missed
+HOTPLUG_RETRY = 0.25         # after a plug-in, until udev/IOKit has made the device openable
+HOTPLUG_RETRIES = 8
+CLEANUP_INTERVAL = 30
+
+
+class _InotifyWatch:
+    """Linux: inotify on the file (writes) and its directory (create/rename/delete)."""
+    IN_MODIFY = 0x002
+    IN_MOVED_FROM = 0x040
+    IN_MOVED_TO = 0x080
+    IN_CREATE = 0x100
+    IN_DELETE = 0x200
+    IN_NONBLOCK = 0o4000
+    IN_CLOEXEC = 0o2000000
+    _EVENT = struct.Struct("iIII")
+
+    def __init__(self, path):
+        libc = ctypes.CDLL(ctypes.util.find_library("c") or "libc.so.6", use_errno=True)
+        self._libc = libc
+        self._fd = libc.inotify_init1(self.IN_NONBLOCK | self.IN_CLOEXEC)
+        if self._fd < 0:
+            raise OSError(ctypes.get_errno(), "inotify_init1 failed")
+        self._name = path.name.encode()
+        self._file_wd = -1
+        mask = self.IN_CREATE | self.IN_DELETE | self.IN_MOVED_FROM | self.IN_MOVED_TO
+        if libc.inotify_add_watch(self._fd, str(path.parent).encode(), mask) < 0:
+            os.close(self._fd)
+            raise OSError(ctypes.get_errno(), "inotify_add_watch failed")
+        self._path = str(path).encode()
+
+    def fileno(self):
+        return self._fd
+
+    def watch(self, f):
+        if self._file_wd >= 0:
+            self._libc.inotify_rm_watch(self._fd, self._file_wd)
+            self._file_wd = -1
+        if f:
+            self._file_wd = self._libc.inotify_add_watch(self._fd, self._path, self.IN_MODIFY)
+
+    def drain(self):
+        """Consume pending notifications. Returns True if the file was replaced."""
+        replaced = False
+        while True:
+            try:
+                data = os.read(self._fd, 4096)
+            except BlockingIOError:
+                return replaced
+            off = 0
+            while off < len(data):
+                wd, mask, _, length = self._EVENT.unpack_from(data, off)
+                name = data[off + self._EVENT.size:off + self._EVENT.size + length].rstrip(b"\x00")
+                off += self._EVENT.size + length
+                if wd != self._file_wd and name == self._name:
+                    replaced = True
+
+
+class _KqueueWatch:
+    """macOS/BSD: kqueue vnode events on the file, plus its directory while it's missing."""
+
+    def __init__(self, path):
+        self._kq = select.kqueue()
+        self._dir_fd = os.open(str(path.parent), os.O_RDONLY)
+        self._watching_dir = False
+
+    def fileno(self):
+        return self._kq.fileno()
+
+    def watch(self, f):
+        if f:
+            flags = select.KQ_NOTE_WRITE | select.KQ_NOTE_EXTEND | select.KQ_NOTE_DELETE | select.KQ_NOTE_RENAME
+            self._kq.control([select.kevent(f.fileno(), select.KQ_FILTER_VNODE,
+                                            select.KQ_EV_ADD | select.KQ_EV_CLEAR, flags)], 0)
+        self._set_dir_watch(f is None)
+
+    def _set_dir_watch(self, on):
+        if on == self._watching_dir:
+            return
+        action = select.KQ_EV_ADD | select.KQ_EV_CLEAR if on else select.KQ_EV_DELETE
+        self._kq.control([select.kevent(self._dir_fd, select.KQ_FILTER_VNODE, action,
+                                        select.KQ_NOTE_WRITE)], 0)
+        self._watching_dir = on
+
+    def drain(self):
+        """Consume pending notifications. Returns True if the file was replaced."""
+        replaced = False
+        gone = select.KQ_NOTE_DELETE | select.KQ_NOTE_RENAME
+        for ev in self._kq.control(None, 16, 0):
+            if ev.ident == self._dir_fd or ev.fflags & gone:
+                replaced = True
+        return replaced
+
+
+class JsonlTail:
+    """Follows an append-only JSONL file with the descriptor kept open.
+
+    Uses kqueue/inotify so the main loop can sleep in select() until the
+    file changes. Without either, fileno() is None and read_new() is simply
+    called on every POLL_INTERVAL tick (checking for replacement by stat).
+    """
+
+    def __init__(self, path):
+        self.path = path
+        self._f = None
+        self._buf = ""
+        backend = _KqueueWatch if hasattr(select, "kqueue") else _InotifyWatch
+        try:
+            self._watch = backend(path)
+        except (OSError, AttributeError):
+            self._watch = None  # no notification API: fall back to polling
+        self._reopen(at_end=True)
+
+    @property
+    def polling(self):
+        return self._watch is None
+
+    def fileno(self):
+        return self._watch.fileno() if self._watch else None
+
+    def _reopen(self, at_end=False):
+        if self._f:
+            self._f.close()
+            self._f = None
+        self._buf = ""
+        try:
+            self._f = open(self.path, "r")
+            if at_end:
+                self._f.seek(0, os.SEEK_END)
+        except OSError:
+            pass
+        if self._watch:
+            self._watch.watch(self._f)
+
+    def _replaced(self):
+        try:
+            st = os.stat(self.path)
+        except OSError:
+            return self._f is not None
+        return self._f is None or st.st_ino != os.fstat(self._f.fileno()).st_ino
+
+    def read_new(self):
+        if self._watch:
+            replaced = self._watch.drain()
+        else:
+            replaced = self._replaced()
+        events = self._read()
+        if replaced:
+            self._reopen()
+            events += self._read()
+        return events
+
+    def _read(self):
+        if not self._f:
+            return []
+        if os.fstat(self._f.fileno()).st_size < self._f.tell():
+            self._f.seek(0)  # truncated
+            self._buf = ""
+        data = self._f.read()
+        if not data:
+            return []
+        lines = (self._buf + data).split("\n")
+        self._buf = lines.pop()  # partial trailing line, completed by the next write
+        events = []
+        for line in lines:
             line = line.strip()
             if line:
                 try:
                     events.append(json.loads(line))
                 except json.JSONDecodeError:
                     pass
-        pos = f.tell()
-    return events, pos
+        return events
 
 
-# === iTerm2 tab switching ===
+class EventSocket:
+    """Unix datagram socket the hook writes to: one JSON record per datagram.
 
-def activate_iterm_tab(iterm_session_id):
-    """Switch iTerm2 to the tab containing the given session ID.
+    Delivery is push-based, so the main loop just adds it to select() and
+    no file I/O happens per event.
+    """
 
-    iterm_session_id format: "w0t0p0:GUID"
-    We extract the tab identifier (e.g. "w0t0") to target the right tab.
+    def __init__(self, path):
+        self.path = path
+        try:
+            os.unlink(path)  # stale socket from a previous run
+        except OSError:
+            pass
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        self._sock.bind(str(path))
+        os.chmod(path, 0o600)
+        self._sock.setblocking(False)
+
+    def fileno(self):
+        return self._sock.fileno()
+
+    def read_new(self):
+        events = []
+        while True:
+            try:
+                data = self._sock.recv(65536)
+            except (BlockingIOError, InterruptedError):
+                break
+            except OSError:
+                break
+            for line in data.splitlines():
+                line = line.strip()
+                if line:
+                    try:
+                        events.append(json.loads(line))
+                    except (json.JSONDecodeError, UnicodeDecodeError):
+                        pass
+        return events
+
+    def close(self):
+        self._sock.close()
+        try:
+            os.unlink(self.path)
+        except OSError:
+            pass
+
+
+class HistoryLog:
+    """Size-bounded JSONL log of received events, written off the hot path.
+
+    The main loop only enqueues; a writer thread appends and rotates the file
+    to `<path>.1` once it exceeds max_bytes, so the log never holds more
+    than about twice that.
     """
-    if not iterm_session_id:
-        return
 
-    # $ITERM_SESSION_ID format: "w0t0p0:GUID" — extract the GUID part
-    # iTerm2's AppleScript "unique ID" is just the GUID
-    guid = iterm_session_id.split(":")[-1] if ":" in iterm_session_id else iterm_session_id
+    def __init__(self, path, max_bytes=HISTORY_MAX_BYTES):
+        self.path = path
+        self.max_bytes = max_bytes
+        self._q = queue.Queue()
+        threading.Thread(target=self._run, daemon=True).start()
+
+    def append(self, event):
+        self._q.put(event)
+
+    def _run(self):
+        while True:
+            batch = [self._q.get()]
+            while True:
+                try:
+                    batch.append(self._q.get_nowait())
+                except queue.Empty:
+                    break
+            try:
+                with open(self.path, "a") as f:
+                    for ev in batch:
+                        f.write(json.dumps(ev) + "\n")
+                    size = f.tell()
+                if size > self.max_bytes:
+                    os.replace(self.path, f"{self.path}.1")
+            except OSError:
+                pass
+
+    def tail(self, n):
+        """Last n logged events (used once at startup to seed the EventRing)."""
+        lines = []
+        for path in (self.path, f"{self.path}.1"):
+            try:
+                with open(path) as f:
+                    lines = f.readlines() + lines
+            except OSError:
+                pass
+            if len(lines) >= n:
+                break
+        events = []
+        for line in lines[-n:]:
+            try:
+                events.append(json.loads(line))
+            except json.JSONDecodeError:
+                pass
+        return events
+
+
+class EventRing:
+    """Fixed-size ring of recent events shared with the dashboard thread.
+
+    The main loop appends as events are ingested; last(n) copies at most
+    EVENT_RING_SIZE entries, so serving /api/events costs the same however
+    long the daemon has been running.
+    """
+
+    def __init__(self, maxlen=EVENT_RING_SIZE, initial=()):
+        self._events = deque(initial, maxlen=maxlen)
+        self._lock = threading.Lock()
+
+    def append(self, event):
+        with self._lock:
+            self._events.append(event)
 
+    def last(self, n):
+        with self._lock:
+            events = list(self._events)
+        return events[-n:] if n > 0 else []
+
+
+def rotate_spool(path, max_bytes=SPOOL_MAX_BYTES):
+    """Keep the fallback spool bounded. Hooks open it per write, so a rename
+    sends new appends to a fresh file; JsonlTail drains the old one first."""
+    try:
+        if os.stat(path).st_size > max_bytes:
+            os.replace(path, f"{path}.old")
+    except OSError:
+        pass
+
+
+# === iTerm2 tab switching ===
+
+class ItermFocus:
+    """Focuses iTerm2 sessions by GUID over one long-lived Python API connection.
+
+    The API's App object keeps the window/tab/session tree current from
+    iTerm's own layout notifications, so a press is a dict lookup plus
+    one activate request on the connection's thread; nothing is spawned.
+    While the API is unavailable (no `iterm2` module, the API is off in
+    iTerm's settings, iTerm not running, GUID not in the tree) it falls
+    back to the osascript walk. The connection is retried after a press
+    finds it down, at most every RETRY seconds.
+    """
+    RETRY = 10  # seconds
+
+    def __init__(self):
+        self._app = None
+        self._loop = None
+        self._wanted = threading.Event()  # a press found no connection
+        try:
+            import iterm2
+        except ImportError:
+            self._iterm2 = None
+            return
+        self._iterm2 = iterm2
+        self._wanted.set()  # connect now, before the first press
+        threading.Thread(target=self._run, daemon=True).start()
+
+    def _run(self):
+        asyncio.set_event_loop(asyncio.new_event_loop())
+        while True:
+            self._wanted.wait()
+            try:
+                self._iterm2.Connection().run_until_complete(self._serve)
+            except (Exception, SystemExit):  # the library exits when iTerm refuses
+                pass
+            self._app = None
+            self._wanted.clear()  # a press during the wait below asks for the next attempt
+            time.sleep(self.RETRY)
+
+    async def _serve(self, connection):
+        self._loop = asyncio.get_running_loop()
+        self._app = await self._iterm2.async_get_app(connection)
+        await connection.websocket.wait_closed()
+
+    async def _activate(self, app, guid):
+        session = app.get_session_by_id(guid)
+        if session is None:
+            return False
+        await session.async_activate(select_tab=True, order_window_front=True)
+        await app.async_activate()
+        return True
+
+    def focus(self, guid):
+        """Focus the session without waiting for iTerm."""
+        app = self._app
+        if app is None:
+            if self._iterm2:
+                self._wanted.set()
+            _osascript_focus(guid)
+            return
+        fut = asyncio.run_coroutine_threadsafe(self._activate(app, guid), self._loop)
+        fut.add_done_callback(lambda f: self._done(f, guid))
+
+    @staticmethod
+    def _done(fut, guid):
+        # Not in the tree (yet), or the connection just dropped
+        if fut.cancelled() or fut.exception() or not fut.result():
+            _osascript_focus(guid)
+
+
+def _osascript_focus(guid):
+    """Walk every window, tab and session in a fresh osascript (slow with many tabs)."""
     script = f'''
     tell application "iTerm2"
         activate
@@ -497,53 +1686,248 @@ def activate_iterm_tab(iterm_session_id):
         pass
 
 
+_iterm_focus = None  # ItermFocus, created on first use
+
+
+def iterm_focus():
+    global _iterm_focus
+    if _iterm_focus is None:
+        _iterm_focus = ItermFocus()
+    return _iterm_focus
+
+
+def activate_iterm_tab(iterm_session_id):
+    """Switch iTerm2 to the tab containing the given session ID.
+
+    iterm_session_id format: "w0t0p0:GUID"
+    We extract the GUID, which is what iTerm2 calls the session's unique ID.
+    """
+    if not iterm_session_id:
+        return
+
+    # $ITERM_SESSION_ID format: "w0t0p0:GUID" — extract the GUID part
+    # iTerm2's AppleScript "unique ID" is just the GUID
+    guid = iterm_session_id.split(":")[-1] if ":" in iterm_session_id else iterm_session_id
+    iterm_focus().focus(guid)
+
+
+def cycle_focus(mgr, focused_sid, delta):
+    """Move iTerm focus delta sessions (in slot order) from focused_sid.
+
+    Returns the newly focused session id.
+    """
+    ordered = sorted((s for s in mgr.sessions.values() if s.iterm_session),
+                     key=lambda s: s.slot)
+    if not ordered or not delta:
+        return focused_sid
+    ids = [s.session_id for s in ordered]
+    if focused_sid in ids:
+        idx = (ids.index(focused_sid) + delta) % len(ids)
+    else:
+        idx = 0 if delta > 0 else len(ids) - 1
+    sess = ordered[idx]
+    print(f"  [{sess.slot}] KNOB {delta:+d} → iTerm {sess.iterm_session}")
+    activate_iterm_tab(sess.iterm_session)
+    return sess.session_id
+
+
 # === LED update logic ===
 
-def update_leds(kb, mgr):
-    """Push current session states to LEDs.
+def pages_used(mgr):
+    """Pages needed to show every session (at least one)."""
+    return max((slot_page(s.slot) + 1 for s in mgr.sessions.values()), default=1)
+
+
+def keyboard_image(mgr):
+    """KeyboardImage of the current session states.
 
     States:
-      your_turn    → pulse (set initial bright here, animated in main loop)
+      your_turn    → pulse DIM_V..ORANGE_V (firmware effect)
       acknowledged → solid bright
-      working      → solid dim
+      working      → breathe BREATHE_MIN_V..BREATHE_MAX_V (firmware effect, gamma-eased
+                     so the slow ramp looks even)
     Stale overlay (idle >5min) → very dim regardless of state.
+
+    kb.apply() diffs this against what the keyboard already holds, so a
+    transition usually costs one delta plus one effect report. The
+    firmware animates from then on; nothing is sent until the next change.
+    The main loop keeps the image current while unplugged too, and
+    kb.replay() uploads it in one batch as soon as the keyboard is back.
+
+    Slots past the first eight go to further pages (one Frame each); the
+    keyboard shows one page at a time and pressing the right knob flips
+    between them (turning it still cycles sessions). Only page 0 carries the underglow, and setting the same mode
+    again doesn't restart it.
     """
-    kb.enter_direct_mode()
-    kb.set_all_leds(0, 0, 0)
+    frames = [Frame(page) for page in range(pages_used(mgr))]
+    pulse = (FX_SINE, int(PULSE_PERIOD * 1000), DIM_V, ORANGE_V, 0)
+    breathe = (FX_SINE | FX_GAMMA, int(BREATHE_PERIOD * 1000), BREATHE_MIN_V, BREATHE_MAX_V, 0)
+    stale = mgr.dimmed
 
-    stale = {s.session_id for s in mgr.get_dimmed()}
+    states = [[0] * SLOTS_PER_PAGE for _ in frames]
 
     for sess in mgr.sessions.values():
-        led = SLOT_LEDS[sess.slot]
+        page = slot_page(sess.slot)
+        frame, led = frames[page], slot_led(sess.slot)
+        states[page][sess.slot % SLOTS_PER_PAGE] = SLOT_STATE_CODES[sess.state]
         is_stale = sess.session_id in stale
 
         if is_stale:
-            kb.set_led(led, ORANGE_H, ORANGE_S, STALE_V)
+            frame.leds[led] = (ORANGE_H, ORANGE_S, STALE_V)
         elif sess.state == "your_turn":
-            # Initial value; the pulse loop animates this
-            kb.set_led(led, ORANGE_H, ORANGE_S, ORANGE_V)
+            frame.leds[led] = (ORANGE_H, ORANGE_S, ORANGE_V)
+            frame.effects[led] = pulse
         elif sess.state == "acknowledged":
-            kb.set_led(led, ORANGE_H, ORANGE_S, ORANGE_V)
+            frame.leds[led] = (ORANGE_H, ORANGE_S, ORANGE_V)
         elif sess.state == "working":
-            kb.set_led(led, ORANGE_H, ORANGE_S, DIM_V)
+            frame.leds[led] = (ORANGE_H, ORANGE_S, DIM_V)
+            frame.effects[led] = breathe
 
-    # Underglow: always breathing while daemon runs
-    kb.set_underglow_breathe(ORANGE_H, ORANGE_S, ORANGE_V)
+    # Underglow: breathing while the daemon runs, a bar of waiting sessions
+    # (counted on-device from the slot states) when any are waiting
+    frames[0].ug_mode = UG_MODE_STATUS
+    frames[0].ug_hsv = (ORANGE_H, ORANGE_S, ORANGE_V)
+    return KeyboardImage(frames, states)
 
 
 # === Dashboard web server ===
 
 DASHBOARD_PORT = 8787
+STREAM_KEEPALIVE = 15  # seconds: an idle /api/stream sends a comment, so dead clients are noticed
 
-# Shared state for the dashboard (read-only from web thread)
+# Dashboard state owned by the main loop. Web threads only use "hub"
+# (its published snapshot) and the "events" ring, both safe to share.
 _dashboard = {
     "mgr": None,
-    "start_time": None,
+    "events": None,
+    "hub": None,
+    "started_at": None,   # wall clock, so stream clients can tick uptime locally
     "protocol": "",
     "connected": False,
+    "keyboards": 0,       # boards connected
+    "page": 0,            # page the keyboard is showing (from EV_PAGE)
+    "firmware": None,     # perf counters from the keyboard, refreshed with the keepalive
 }
 
 
+def session_info(sess):
+    """Dashboard view of a session. Clients derive idle time from
+    last_event_at, so the record only changes when the session does."""
+    return {
+        "session_id": sess.session_id,
+        "state": sess.state,
+        "slot": sess.slot,
+        "page": slot_page(sess.slot),
+        "led_index": slot_led(sess.slot),
+        "last_event_at": sess.last_event_at,
+        "iterm_session": sess.iterm_session or "",
+    }
+
+
+def status_info():
+    mgr = _dashboard["mgr"]
+    return {
+        "connected": _dashboard["connected"],
+        "keyboards": _dashboard["keyboards"],
+        "protocol": _dashboard["protocol"],
+        "started_at": _dashboard["started_at"],
+        "slots_used": mgr.slots_used if mgr else 0,
+        "slots_total": MAX_SLOTS,
+        "page": _dashboard["page"],
+        "pages": pages_used(mgr) if mgr else 1,
+        "firmware": _dashboard["firmware"],
+    }
+
+
+# Immutable view of daemon state for HTTP handler threads: a tuple of
+# session_info dicts and a status dict, never mutated once published.
+DashboardSnapshot = namedtuple("DashboardSnapshot", ["sessions", "status"])
+
+
+class DashboardHub:
+    """Hands daemon state to the dashboard server threads.
+
+    The main loop calls publish() once per iteration. When anything changed
+    it swaps in a new DashboardSnapshot; handlers just read `snapshot` (a
+    single attribute load, no lock), so they never touch SessionManager or
+    hold up the LED loop.
+
+    It also fans updates out to /api/stream subscribers (Server-Sent Events).
+    Only what changed since the last call is sent, so an idle daemon sends
+    nothing. The firmware perf counters move with every keepalive, so a
+    change to them alone is streamed at most every FIRMWARE_PUSH seconds;
+    /api/status always has the current ones. A new subscriber first gets status, the full session list and
+    recent events. New events are added to the EventRing here too, under the
+    same lock as the subscribe snapshot, so a subscriber never sees an event
+    twice or misses one.
+    """
+
+    QUEUE_MAX = 1000  # a client this far behind is dropped
+    FIRMWARE_PUSH = 60  # seconds between status events that only carry new perf counters
+
+    def __init__(self, ring):
+        self._ring = ring
+        self._lock = threading.Lock()
+        self._subs = set()
+        self._sessions = {}   # session_id → last published session_info
+        self._status = status_info()  # as last streamed
+        self._status_at = 0.0         # time.monotonic() of that
+        self.snapshot = DashboardSnapshot((), self._status)
+
+    @staticmethod
+    def _encode(kind, data):
+        return f"event: {kind}\ndata: {json.dumps(data)}\n\n".encode()
+
+    def subscribe(self, n_events=200):
+        q = queue.Queue(self.QUEUE_MAX)
+        with self._lock:
+            q.put(self._encode("status", self.snapshot.status))
+            q.put(self._encode("sessions", {"sessions": list(self._sessions.values())}))
+            q.put(self._encode("events", {"events": self._ring.last(n_events)}))
+            self._subs.add(q)
+        return q
+
+    def unsubscribe(self, q):
+        with self._lock:
+            self._subs.discard(q)
+
+    def _broadcast(self, kind, data):
+        msg = self._encode(kind, data)
+        for q in list(self._subs):
+            try:
+                q.put_nowait(msg)
+            except queue.Full:
+                self._subs.discard(q)
+                with q.mutex:
+                    q.queue.clear()
+                q.put_nowait(None)  # tells the handler to hang up
+
+    def publish(self, mgr, events=()):
+        sessions = {sid: session_info(s) for sid, s in mgr.sessions.items()}
+        status = status_info()
+        now = time.monotonic()
+        with self._lock:
+            changed = status != self.snapshot.status
+            if status != self._status and (dict(status, firmware=None) != dict(self._status, firmware=None)
+                                           or now - self._status_at >= self.FIRMWARE_PUSH):
+                self._status = status
+                self._status_at = now
+                self._broadcast("status", status)
+            for sid, info in sessions.items():
+                if self._sessions.get(sid) != info:
+                    changed = True
+                    self._broadcast("session", info)
+            for sid in self._sessions.keys() - sessions.keys():
+                changed = True
+                self._broadcast("session_removed", {"session_id": sid})
+            if changed:
+                self._sessions = sessions
+                self.snapshot = DashboardSnapshot(tuple(sessions.values()), status)
+            for ev in events:
+                self._ring.append(ev)
+                self._broadcast("event", ev)
+
+
 class DashboardHandler(BaseHTTPRequestHandler):
 
     def do_GET(self):
@@ -559,6 +1943,8 @@ class DashboardHandler(BaseHTTPRequestHandler):
             self._api_events(n)
         elif path == "/api/status":
             self._api_status()
+        elif path == "/api/stream":
+            self._api_stream()
         else:
             self.send_error(404)
 
@@ -581,112 +1967,474 @@ class DashboardHandler(BaseHTTPRequestHandler):
         except FileNotFoundError:
             self.send_error(404, "dashboard.html not found")
 
+    def _snapshot(self):
+        hub = _dashboard["hub"]
+        return hub.snapshot if hub else DashboardSnapshot((), status_info())
+
     def _api_sessions(self):
-        mgr = _dashboard["mgr"]
-        if not mgr:
-            return self._json({"sessions": []})
-        now = time.monotonic()
+        now = time.time()
         sessions = []
-        for sess in list(mgr.sessions.values()):
-            sessions.append({
-                "session_id": sess.session_id,
-                "state": sess.state,
-                "slot": sess.slot,
-                "led_index": SLOT_LEDS[sess.slot],
-                "idle_seconds": round(now - sess.last_event_time, 1),
-                "iterm_session": sess.iterm_session or "",
-            })
+        for info in self._snapshot().sessions:
+            info = dict(info, idle_seconds=round(now - info["last_event_at"], 1))
+            sessions.append(info)
         self._json({"sessions": sessions})
 
     def _api_events(self, n=200):
-        events = []
-        if STATE_FILE.exists():
-            try:
-                with open(STATE_FILE) as f:
-                    lines = f.readlines()
-                for line in lines[-n:]:
-                    line = line.strip()
-                    if line:
-                        try:
-                            events.append(json.loads(line))
-                        except json.JSONDecodeError:
-                            pass
-            except OSError:
-                pass
-        self._json({"events": events})
+        ring = _dashboard["events"]
+        self._json({"events": ring.last(n) if ring else []})
 
     def _api_status(self):
-        start = _dashboard["start_time"]
-        uptime = time.monotonic() - start if start else 0
-        mgr = _dashboard["mgr"]
-        slots_used = sum(mgr.slot_used) if mgr else 0
-        self._json({
-            "connected": _dashboard["connected"],
-            "protocol": _dashboard["protocol"],
-            "uptime_seconds": round(uptime, 1),
-            "slots_used": slots_used,
-            "slots_total": MAX_SLOTS,
-        })
+        status = self._snapshot().status
+        uptime = time.time() - status["started_at"] if status["started_at"] else 0
+        self._json(dict(status, uptime_seconds=round(uptime, 1)))
+
+    def _api_stream(self):
+        hub = _dashboard["hub"]
+        if not hub:
+            return self.send_error(503)
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream")
+        self.send_header("Cache-Control", "no-cache")
+        self.send_header("Access-Control-Allow-Origin", "*")
+        self.end_headers()
+        q = hub.subscribe()
+        try:
+            while True:
+                try:
+                    msg = q.get(timeout=STREAM_KEEPALIVE)
+                except queue.Empty:
+                    msg = b":\n\n"  # SSE comment; a write to a closed client fails and ends the loop
+                if msg is None:
+                    break
+                self.wfile.write(msg)
+                self.wfile.flush()
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+        finally:
+            hub.unsubscribe(q)
 
     def log_message(self, format, *args):
         pass
 
 
 def start_dashboard(port=DASHBOARD_PORT):
-    server = HTTPServer(("127.0.0.1", port), DashboardHandler)
+    server = ThreadingHTTPServer(("127.0.0.1", port), DashboardHandler)  # /api/stream holds its thread
     thread = threading.Thread(target=server.serve_forever, daemon=True)
     thread.start()
     return server
 
 
-# === Main loop ===
+# === Hotplug ===
+
+class _UeventHotplug:
+    """Linux: kernel uevents; a hidraw node being added means a HID device arrived."""
+    NETLINK_KOBJECT_UEVENT = 15
+    KERNEL_GROUP = 1
+
+    def __init__(self):
+        self._sock = socket.socket(socket.AF_NETLINK, socket.SOCK_DGRAM | socket.SOCK_NONBLOCK,
+                                   self.NETLINK_KOBJECT_UEVENT)
+        self._sock.bind((0, self.KERNEL_GROUP))
 
-def try_connect():
-    """Try VIALRGB first, fall back to Raw HID. Returns None if not found."""
-    vial = VialRGBProtocol()
-    if vial.connect():
-        return vial
-    raw = RawHIDProtocol()
-    if raw.connect():
-        return raw
+    def fileno(self):
+        return self._sock.fileno()
+
+    def drain(self):
+        """Consume pending uevents. Returns True if a hidraw device was added."""
+        added = False
+        while True:
+            try:
+                msg = self._sock.recv(8192)
+            except BlockingIOError:
+                return added
+            fields = msg.split(b"\x00")
+            if fields[0].startswith(b"add@") and b"SUBSYSTEM=hidraw" in fields:
+                added = True
+
+
+class _IOKitHotplug:
+    """macOS: IOKit first-match notifications for the keyboard's HID interfaces.
+
+    IOKit delivers them on a CFRunLoop, so a daemon thread runs one and
+    wakes select() through a Waker.
+    """
+    kCFStringEncodingUTF8 = 0x08000100
+    kCFNumberSInt32Type = 3
+    _CALLBACK = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_uint32)
+
+    def __init__(self):
+        self._iokit = ctypes.CDLL(ctypes.util.find_library("IOKit"))
+        self._cf = ctypes.CDLL(ctypes.util.find_library("CoreFoundation"))
+        self._waker = Waker()
+        self._callback = self._CALLBACK(self._on_match)  # referenced for as long as IOKit may call it
+        self._error = None
+        ready = threading.Event()
+        threading.Thread(target=self._run, args=(ready,), daemon=True).start()
+        if not ready.wait(2) or self._error:
+            raise OSError(self._error or "IOKit notification thread didn't start")
+
+    def _run(self, ready):
+        iokit, cf = self._iokit, self._cf
+        vp = ctypes.c_void_p
+        iokit.IONotificationPortCreate.restype = vp
+        iokit.IONotificationPortGetRunLoopSource.restype = vp
+        iokit.IONotificationPortGetRunLoopSource.argtypes = [vp]
+        iokit.IOServiceMatching.restype = vp
+        iokit.IOServiceAddMatchingNotification.argtypes = [
+            vp, ctypes.c_char_p, vp, self._CALLBACK, vp, ctypes.POINTER(ctypes.c_uint32)]
+        cf.CFRunLoopGetCurrent.restype = vp
+        cf.CFRunLoopAddSource.argtypes = [vp, vp, vp]
+        cf.CFStringCreateWithCString.restype = vp
+        cf.CFStringCreateWithCString.argtypes = [vp, ctypes.c_char_p, ctypes.c_uint32]
+        cf.CFNumberCreate.restype = vp
+        cf.CFNumberCreate.argtypes = [vp, ctypes.c_int, vp]
+        cf.CFDictionarySetValue.argtypes = [vp, vp, vp]
+        try:
+            port = iokit.IONotificationPortCreate(0)  # kIOMainPortDefault
+            cf.CFRunLoopAddSource(cf.CFRunLoopGetCurrent(), iokit.IONotificationPortGetRunLoopSource(port),
+                                  vp.in_dll(cf, "kCFRunLoopDefaultMode"))
+            matching = iokit.IOServiceMatching(b"IOHIDDevice")
+            for key, value in (("VendorID", WL_VID), ("ProductID", WL_PID)):
+                num = ctypes.c_int32(value)
+                cf.CFDictionarySetValue(
+                    matching, cf.CFStringCreateWithCString(None, key.encode(), self.kCFStringEncodingUTF8),
+                    cf.CFNumberCreate(None, self.kCFNumberSInt32Type, ctypes.addressof(num)))
+            it = ctypes.c_uint32()
+            kr = iokit.IOServiceAddMatchingNotification(port, b"IOServiceFirstMatch", matching,
+                                                        self._callback, None, ctypes.byref(it))
+            if kr:
+                self._error = f"IOServiceAddMatchingNotification failed ({kr:#x})"
+                return
+            self._drain_iterator(it.value)  # arms the notification; present devices are ignored
+        except (OSError, AttributeError, ValueError) as e:
+            self._error = str(e)
+            return
+        finally:
+            ready.set()
+        cf.CFRunLoopRun()
+
+    def _drain_iterator(self, it):
+        arrived = False
+        while True:
+            obj = self._iokit.IOIteratorNext(it)
+            if not obj:
+                return arrived
+            self._iokit.IOObjectRelease(obj)
+            arrived = True
+
+    def _on_match(self, refcon, it):
+        if self._drain_iterator(it):
+            self._waker.set()
+
+    def fileno(self):
+        return self._waker.fileno()
+
+    def drain(self):
+        """Returns True if a keyboard interface appeared since the last call."""
+        try:
+            arrived = bool(os.read(self._waker.fileno(), 512))
+        except BlockingIOError:
+            return False
+        self._waker.clear()
+        return arrived
+
+
+def hotplug_watch():
+    """Event source for keyboard plug-ins, or None if the platform has none (poll instead)."""
+    try:
+        if sys.platform == "darwin":
+            return _IOKitHotplug()
+        if hasattr(socket, "AF_NETLINK"):
+            return _UeventHotplug()
+    except (OSError, AttributeError) as e:
+        print(f"Hotplug notifications unavailable ({e}); polling for the keyboard")
     return None
 
 
+# === Keyboards ===
+
+class KeyboardWorker:
+    """One board and the thread that does all of its I/O, connecting included.
+
+    The main loop hands it images and on-device acks without waiting.
+    Only the newest image is kept, so a board that falls behind skips
+    states instead of queuing them, and a slow connect, a lost reply or
+    an unplug only holds up this board. Images flagged replay (the first
+    one, and any after the board moved) are replayed, the rest applied.
+    """
+
+    def __init__(self, kb, connect, on_wake=None):
+        self.kb = kb
+        self.up = False           # connect() succeeded; set by the worker thread
+        self.failed = False       # connect() failed; the thread is done
+        self.position = None      # place in the KeyboardSet fan-out, once up
+        self._connect = connect   # runs on the worker thread
+        self._on_wake = on_wake   # told when connect() has finished
+        self._cond = threading.Condition()
+        self._image = None
+        self._replay = True
+        self._acks = []           # (page, slot, seq) for kb.note_local_ack, in order; slot None = resync page
+        self._beat = False        # keepalive due
+        self._shown = None        # last image sent, replayed if the board loses it
+        self._stopping = False
+        self._farewell = False
+        kb.on_reset = self.keepalive  # the keepalive's reply decides whether to replay
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def show(self, image, replay=False):
+        with self._cond:
+            self._image = image
+            self._replay |= replay
+            self._cond.notify()
+
+    def note_local_ack(self, page, slot, seq):
+        with self._cond:
+            self._acks.append((page, slot, seq))
+            self._cond.notify()
+
+    def resync_page(self, page):
+        """An on-device ack was refused: resend the page's look and slot states."""
+        with self._cond:
+            self._acks.append((page, None, None))
+            self._cond.notify()
+
+    def keepalive(self):
+        """Feed the board's watchdog and refresh its perf counters, on the worker."""
+        with self._cond:
+            self._beat = True
+            self._cond.notify()
+
+    def stop(self, farewell=False):
+        """Let the thread finish (blanking the board first if farewell) and close it."""
+        with self._cond:
+            self._stopping = True
+            self._farewell = farewell
+            self._cond.notify()
+
+    def join(self, timeout=None):
+        self._thread.join(timeout)
+
+    def _run(self):
+        kb = self.kb
+        ok = self._connect()
+        self.up, self.failed = ok, not ok
+        if self._on_wake:
+            self._on_wake()
+        if not ok:
+            return
+        while True:
+            with self._cond:
+                while not (self._stopping or self._image is not None or self._acks or self._beat):
+                    self._cond.wait()
+                if self._stopping:
+                    break
+                acks, self._acks = self._acks, []
+                image, self._image = self._image, None
+                beat, self._beat = self._beat, False
+                replay, self._replay = self._replay, False
+            for page, slot, seq in acks:  # before the image: it was built after them
+                if slot is None:
+                    kb.forget_page(page)
+                    if image is None:
+                        image = self._shown
+                else:
+                    kb.note_local_ack(page, slot, seq)
+            if beat:
+                kb.keepalive()
+                kb.poll_perf()
+                if kb.resync_needed:  # e.g. the firmware watchdog fired while the host slept
+                    kb.resync_needed = False
+                    replay = True
+                    if image is None:
+                        image = self._shown
+            if image is not None:
+                (kb.replay if replay else kb.apply)(image)
+                self._shown = image
+        try:
+            if self._farewell:
+                kb.enter_direct_mode()
+                kb.set_all_leds(0, 0, 0)
+                kb.set_underglow(0, 0, 0)
+                kb.disarm()  # else the watchdog shows "host lost" and reloads EEPROM RGB over this
+        except Exception:
+            pass
+        kb.close()
+
+
+class KeyboardSet:
+    """Every attached board, each driven by its own KeyboardWorker.
+
+    The connected boards are numbered 0..n-1 in the order their keys
+    (raw_hid_boards()) were first seen, so a replugged board gets its
+    old place back and an unplugged one leaves no gap. Image page g
+    goes to the board at position g % n as its page g // n, so two
+    boards show 16 slots before either needs to flip. Whenever the
+    numbering changes every board is replayed its new share. Every
+    board gets page 0's underglow and blanks its unused keys.
+    """
+
+    def __init__(self, on_wake=None):
+        self._on_wake = on_wake
+        self.workers = {}  # board key → KeyboardWorker, still connecting ones included
+        self._seen = []    # board keys in first-seen order
+        self._placed = []  # connected workers by position
+
+    def __bool__(self):
+        return bool(self._placed)
+
+    def __len__(self):
+        return len(self._placed)
+
+    @property
+    def first(self):
+        """Worker at position 0 (the dashboard shows its protocol and perf)."""
+        return self._placed[0] if self._placed else None
+
+    def scan(self):
+        """Start a worker for every attached board that has none.
+
+        Only enumerates: the workers connect, and update() places them
+        once they're up. VIALRGB is tried first, as the only keyboard.
+        """
+        if not self.workers and VialRGBProtocol.present():
+            vial = VialRGBProtocol()
+            self._start("vial", vial, vial.connect)
+            return
+        if "vial" in self.workers:
+            return
+        for key, path in raw_hid_boards().items():
+            if key not in self.workers:
+                kb = RawHIDProtocol(on_wake=self._on_wake)
+                self._start(key, kb, lambda kb=kb, path=path: kb.connect(path))
+
+    def _start(self, key, kb, connect):
+        if key not in self._seen:
+            self._seen.append(key)
+        self.workers[key] = KeyboardWorker(kb, connect, self._on_wake)
+
+    def update(self, image):
+        """Forget boards that failed to connect or went away and place new ones.
+
+        Returns (boards added, boards lost). If either is nonzero the
+        positions are renumbered and every board replays its share.
+        """
+        added = lost = 0
+        for key, w in list(self.workers.items()):
+            if w.failed:
+                del self.workers[key]
+            elif w.up and not w.kb.connected:
+                self.workers.pop(key).stop()
+                lost += 1
+            elif w.up and w.position is None:
+                added += 1
+        if added or lost:
+            self._placed = [self.workers[k] for k in self._seen
+                            if k in self.workers and self.workers[k].up]
+            for position, w in enumerate(self._placed):
+                w.position = position
+                w.show(self._split(image, position), replay=True)
+        return added, lost
+
+    def _split(self, image, position):
+        """The part of image the board at position shows, renumbered to its own pages."""
+        n = len(self._placed)
+        frames, states = [], []
+        for frame in image.frames:
+            if frame.page % n == position:
+                mine = frame.copy()
+                mine.page = frame.page // n
+                frames.append(mine)
+                states.append(image.states[frame.page])
+        if not frames:
+            frames, states = [Frame(0)], [[0] * SLOTS_PER_PAGE]
+        frames[0].ug_mode = image.frames[0].ug_mode
+        frames[0].ug_hsv = image.frames[0].ug_hsv
+        return KeyboardImage(frames, states)
+
+    def show(self, image):
+        """Fan image out to every connected board; returns at once."""
+        for w in self._placed:
+            w.show(self._split(image, w.position))
+
+    def slot(self, worker, page, slot):
+        """Session slot of a board's key (slot within its page)."""
+        return self.page(worker, page) * SLOTS_PER_PAGE + slot
+
+    def page(self, worker, page):
+        """Image page a board's page shows."""
+        return page * len(self._placed) + worker.position
+
+    def key_events(self):
+        """(worker, KeyEvent) for every key event queued by any connected board."""
+        for w in list(self._placed):
+            while True:
+                key = w.kb.poll_key_event()
+                if not key:
+                    break
+                yield w, key
+
+    def keepalive(self):
+        for w in self._placed:
+            w.keepalive()
+
+    def close(self, farewell=False):
+        workers, self.workers, self._placed = list(self.workers.values()), {}, []
+        for w in workers:
+            w.stop(farewell)
+        for w in workers:  # in parallel: each blanks its own board
+            w.join(timeout=1)
+
+
+# === Main loop ===
+
+
 def main():
-    mgr = SessionManager()
+    mgr = SessionManager(SLOT_FILE)
+    waker = Waker()  # HID reader thread wakes the loop on key events
+    image = keyboard_image(mgr)  # what the keyboard should show; kept current while unplugged
     leds_dirty = False
+    history = HistoryLog(HISTORY_FILE)
+    ring = EventRing(initial=history.tail(EVENT_RING_SIZE))  # survives restarts via the log
 
     # Start web dashboard first — works even without keyboard
     _dashboard["mgr"] = mgr
-    _dashboard["start_time"] = time.monotonic()
+    _dashboard["events"] = ring
+    _dashboard["started_at"] = time.time()
+    _dashboard["hub"] = hub = DashboardHub(ring)
     start_dashboard()
     print(f"Dashboard: http://localhost:{DASHBOARD_PORT}")
-
-    # Try initial keyboard connection
-    kb = try_connect()
-    if kb:
-        _dashboard["connected"] = True
-        _dashboard["protocol"] = type(kb).__name__.replace("Protocol", "")
-        kb.set_underglow_breathe(ORANGE_H, ORANGE_S, ORANGE_V)
-        print(f"Keyboard connected ({_dashboard['protocol']}).")
-    else:
+    iterm_focus()  # connect to iTerm's API before the first key press
+
+    def boards_changed():
+        first = boards.first
+        _dashboard["connected"] = bool(boards)
+        _dashboard["keyboards"] = len(boards)
+        _dashboard["protocol"] = type(first.kb).__name__.replace("Protocol", "") if first else ""
+        _dashboard["firmware"] = first.kb.perf if first else None
+
+    # Try initial keyboard connection. Every board found gets its own
+    # worker thread, which connects it; once it's up the loop places it
+    # and the worker brings it up to the image in one batch.
+    hotplug = hotplug_watch()  # plug-ins wake the loop; without it, poll
+    reconnect_interval = RECONNECT_FALLBACK if hotplug else RECONNECT_INTERVAL
+    boards = KeyboardSet(on_wake=waker.set)
+    boards.scan()
+    if not boards.workers:
         print("Keyboard not found. Will keep trying...")
 
-    pos = STATE_FILE.stat().st_size if STATE_FILE.exists() else 0
+    events_sock = EventSocket(EVENT_SOCKET)
+    tail = JsonlTail(STATE_FILE)  # hooks fall back to the spool if the socket is down
     last_cleanup = time.monotonic()
-    last_connect_attempt = time.monotonic()
+    next_connect = time.monotonic() + reconnect_interval
+    plug_retries = 0  # quick retries left after a plug-in notification
     last_heartbeat = time.monotonic()
-    last_pulse_v = {}
+    focused_sid = None  # session last focused from the keyboard
 
     def quit_handler(sig=None, frame=None):
-        if kb:
-            try:
-                kb.enter_direct_mode()
-                kb.set_all_leds(0, 0, 0)
-                kb.set_underglow(0, 0, 0)
-                kb.close()
-            except Exception:
-                pass
+        boards.close(farewell=True)
+        events_sock.close()
+        mgr.flush()
         print("\nBye.")
         sys.exit(0)
 
@@ -698,34 +2446,39 @@ def main():
     while True:
         now = time.monotonic()
 
-        # 0. Reconnect if keyboard not connected
-        if kb is None:
-            if now - last_connect_attempt > 3:
-                last_connect_attempt = now
-                kb = try_connect()
-                if kb:
-                    _dashboard["connected"] = True
-                    _dashboard["protocol"] = type(kb).__name__.replace("Protocol", "")
-                    kb.set_underglow_breathe(ORANGE_H, ORANGE_S, ORANGE_V)
-                    leds_dirty = True
-                    last_heartbeat = now
-                    print(f"Keyboard connected ({_dashboard['protocol']}).")
-
-        # 1. Heartbeat: detect keyboard disconnection
-        if kb and now - last_heartbeat > 5:
+        # 0. Look for boards that aren't connected yet. A plug-in
+        #    notification scans right away (retrying briefly while the OS
+        #    sets the device up); otherwise fall back to a slow poll.
+        if hotplug and hotplug.drain():
+            next_connect, plug_retries = now, HOTPLUG_RETRIES
+        if now >= next_connect:
+            boards.scan()  # enumeration only; workers connect and wake us
+            if plug_retries:
+                plug_retries -= 1
+                next_connect = now + HOTPLUG_RETRY
+            else:
+                next_connect = now + reconnect_interval
+
+        # 1. Keepalive (feeds each firmware watchdog and replays boards that
+        #    lost their state, on their workers). Raw HID unplugs are
+        #    reported by the reader threads, which wake us immediately.
+        if boards and now - last_heartbeat >= HEARTBEAT_INTERVAL:
             last_heartbeat = now
-            if not kb.ping():
-                print("Keyboard disconnected.")
-                kb.close()
-                kb = None
-                _dashboard["connected"] = False
-                leds_dirty = False
-                last_pulse_v.clear()
-
-        # 2. Read JSONL events (works without keyboard)
-        events, pos = read_new_events(pos)
+            boards.keepalive()
+            boards_changed()
+        added, lost = boards.update(image)
+        if added or lost:
+            boards_changed()
+            if added:
+                print(f"Keyboard connected ({_dashboard['protocol']}, {len(boards)} board(s)).")
+            if lost:
+                print(f"Keyboard disconnected ({len(boards)} board(s) left).")
+
+        # 2. Read hook events from the socket and the spool (works without keyboard)
+        events = events_sock.read_new() + tail.read_new()
 
         for ev in events:
+            history.append(ev)
             event = ev.get("event", "")
             notif = ev.get("notif", "")
             session_id = ev.get("session", "")
@@ -739,87 +2492,256 @@ def main():
                 continue
 
             if event in YOUR_TURN or (event == "Notification" and notif in YOUR_TURN_NOTIF):
-                if sess.state != "your_turn":
-                    sess.state = "your_turn"
+                if mgr.set_state(sess, "your_turn"):
                     leds_dirty = True
                     print(f"  [{sess.slot}] >>> Your turn ({event} {notif})")
 
             elif event in CLAUDE_WORKING:
-                if sess.state in ("your_turn", "acknowledged"):
-                    sess.state = "working"
+                if mgr.set_state(sess, "working"):
                     leds_dirty = True
-                    last_pulse_v.pop(SLOT_LEDS[sess.slot], None)
                     print(f"  [{sess.slot}] <<< Working ({event})")
 
-        # 3. Poll for key events (keyboard required)
-        if kb:
-            key = kb.poll_key_event()
-            if key:
-                row, col = key
-                slot = KEY_TO_SLOT.get((row, col))
-                if slot is not None:
-                    sess = mgr.get_by_slot(slot)
-                    if sess and sess.iterm_session:
-                        print(f"  [{slot}] KEY row={row} col={col} → iTerm {sess.iterm_session}")
-                        activate_iterm_tab(sess.iterm_session)
-                        if sess.state == "your_turn":
-                            sess.state = "acknowledged"
-                            leds_dirty = True
-                            last_pulse_v.pop(SLOT_LEDS[sess.slot], None)
-                            print(f"  [{slot}] ✓ Acknowledged")
-                    else:
-                        print(f"  [{slot}] KEY row={row} col={col} (no session)")
+        # 3. Drain key events queued by the reader threads (keyboard required)
+        for board, key in boards.key_events():
+            if key.type == EV_PAGE:
+                _dashboard["page"] = boards.page(board, key.row)  # flipped on-device; just mirror it
+                continue
+            if key.type == EV_ACK:
+                # Already showing on the keyboard; catch up with what it did,
+                # unless a hook moved the session on before the firmware saw it
+                slot = boards.slot(board, key.page, key.row)
+                sess = mgr.get_by_slot(slot)
+                if sess and sess.state == "your_turn":
+                    board.note_local_ack(key.page, key.row, key.col)
+                    mgr.set_state(sess, "acknowledged")
+                    leds_dirty = True
+                    print(f"  [{slot}] ✓ Acknowledged (on-device)")
+                else:
+                    board.resync_page(key.page)
+                continue
+            if key.type == EV_ENCODER and key.row == SESSION_ENCODER:
+                focused_sid = cycle_focus(mgr, focused_sid, key.col)
+                continue
+            if key.type != EV_KEY_DOWN:
+                continue
+            row, col = key.row, key.col
+            key_slot = KEY_TO_SLOT.get((row, col))
+            if key_slot is not None:
+                slot = boards.slot(board, key.page, key_slot)
+                sess = mgr.get_by_slot(slot)
+                if sess and sess.iterm_session:
+                    print(f"  [{slot}] KEY row={row} col={col} → iTerm {sess.iterm_session}")
+                    activate_iterm_tab(sess.iterm_session)
+                    focused_sid = sess.session_id
+                    # The firmware only acks keys it already holds as your-turn
+                    if sess.state == "your_turn" and not board.kb.acks_slot(key.page, key_slot):
+                        mgr.set_state(sess, "acknowledged")
+                        leds_dirty = True
+                        print(f"  [{slot}] ✓ Acknowledged")
+                else:
+                    print(f"  [{slot}] KEY row={row} col={col} (no session)")
 
         # 4. Periodic cleanup of stale sessions
-        if now - last_cleanup > 30:
+        if now - last_cleanup >= CLEANUP_INTERVAL:
             stale = mgr.cleanup_stale()
             if stale:
                 leds_dirty = True
                 for sid in stale:
                     print(f"  Released stale session {sid[:8]}...")
             last_cleanup = now
-
-        # 5. Update LEDs if anything changed (keyboard required)
-        if leds_dirty and kb:
-            update_leds(kb, mgr)
-            last_pulse_v.clear()
+            rotate_spool(STATE_FILE)
+            mgr.flush()
+
+        # 5. Sessions crossing DIM_TIMEOUT switch to the stale look
+        if mgr.refresh_dimmed():
+            leds_dirty = True
+
+        # 6. Update the image if anything changed and fan it out to the
+        #    boards' workers (never waits on a board). Pulse/breathe
+        #    animation runs on-device, so this is the only traffic; changes
+        #    while unplugged wait in the image.
+        if leds_dirty:
+            image = keyboard_image(mgr)
             leds_dirty = False
+            boards.show(image)
+            _dashboard["page"] = min(_dashboard["page"], len(image.frames) - 1)
+
+        # 7. Record new events and push whatever changed to stream clients
+        hub.publish(mgr, events)
+
+        # Sleep until a key or hook event arrives, or the earliest deadline.
+        # Animation runs on-device, so there is no host frame deadline and an
+        # idle daemon wakes only for cleanup and the heartbeat/reconnect.
+        deadlines = [last_cleanup + CLEANUP_INTERVAL, next_connect]
+        if boards:
+            deadlines.append(last_heartbeat + HEARTBEAT_INTERVAL)
+        dim_at = mgr.next_dim_time()
+        if dim_at is not None:
+            deadlines.append(dim_at)
+        fds = [waker, events_sock]
+        if tail.polling:
+            deadlines.append(now + POLL_INTERVAL)
+        else:
+            fds.append(tail)
+        if hotplug:
+            fds.append(hotplug)
+        select.select(fds, [], [], max(0.0, min(deadlines) - time.monotonic()))
+        waker.clear()
+
 
-        # 6. Animate pulse for "your_turn" LEDs (keyboard required)
-        if kb and mgr.any_your_turn():
-            stale_ids = {s.session_id for s in mgr.get_dimmed()}
-            t = now % PULSE_PERIOD
-            pulse = (math.sin(t / PULSE_PERIOD * 2 * math.pi - math.pi / 2) + 1) / 2
-            v = int(DIM_V + (ORANGE_V - DIM_V) * pulse)
-            v = v // PULSE_QUANT * PULSE_QUANT
+# === Benchmark (--bench) ===
 
-            for sess in mgr.sessions.values():
-                if sess.state != "your_turn" or sess.session_id in stale_ids:
+BENCH_ROUNDS = 500       # round trips per command
+BENCH_WINDOW = 8         # requests in flight for the pipelined rate test
+BENCH_JITTER_SAMPLES = 40
+BENCH_KEY_SECONDS = 10   # how long to collect key presses for the dispatch test
+SEQ_CMDS = (0x0B, 0x0D, 0x12, 0x13)  # replies carry the new frame seq in byte 2
+
+
+def _summary(samples):
+    """Percentiles of samples (seconds) as one line in ms."""
+    if not samples:
+        return "no samples"
+    s = sorted(samples)
+
+    def pick(q):
+        return s[min(len(s) - 1, int(q * len(s)))] * 1000
+    return (f"p50 {pick(0.5):7.2f}  p90 {pick(0.9):7.2f}  p99 {pick(0.99):7.2f}  "
+            f"max {s[-1] * 1000:7.2f} ms  (n={len(s)})")
+
+
+def _echo(kb):
+    """0x15 round trip. Returns (firmware ms, firmware rx_count) or None."""
+    resp = kb._send(bytes([0x15]))
+    if not resp or resp[0] != 0x15 or resp[1] != kb.STATUS_OK:
+        return None
+    return struct.unpack_from("<IH", resp, 2)
+
+
+def bench_latency(kb, rounds):
+    """Sequential round trip per command, one request in flight."""
+    orange = (ORANGE_H, ORANGE_S, ORANGE_V)
+    commands = [
+        ("echo 0x15", lambda seq, i: bytes([0x15])),
+        ("ping 0xF0", lambda seq, i: bytes([0xF0])),
+        ("set LED 0x01", lambda seq, i: bytes([0x01, SLOT_LEDS[i % 8], *orange])),
+        ("commit 0x0B", lambda seq, i: bytes([0x0B, ORANGE_H, ORANGE_S]) + bytes([i & 0x7F] * NUM_LEDS)
+            + bytes(7)),
+        ("delta 0x0D", lambda seq, i: bytes([0x0D, seq, SLOT_LEDS[i % 8], 1, ORANGE_H, ORANGE_S, i & 0xFF])),
+        ("indexed 0x13", lambda seq, i: bytes([0x13, seq, 0]) + bytes([(i % 4) * 0x11] * 6)),
+        ("effect 0x0C", lambda seq, i: struct.pack("<BHBHBBB", 0x0C, 1 << SLOT_LEDS[i % 8], FX_SINE,
+                                                   1000 + i % 2, 0, ORANGE_V, 0)),
+        ("states 0x10", lambda seq, i: bytes([0x10, 0]) + bytes([i % 4] * SLOTS_PER_PAGE)),
+    ]
+    seq = kb.commit_frame(0, 0, [0] * NUM_LEDS) or 0
+    for name, build in commands:
+        samples, errors = [], 0
+        for i in range(rounds):
+            msg = build(seq, i)
+            t0 = time.perf_counter()
+            resp = kb._send(msg)
+            dt = time.perf_counter() - t0
+            if resp and resp[1] == kb.STATUS_OK:
+                samples.append(dt)
+            else:
+                errors += 1
+            if resp and msg[0] in SEQ_CMDS:
+                seq = resp[2]
+        print(f"  {name:13} {_summary(samples)}" + (f"  {errors} failed" if errors else ""))
+
+
+def bench_throughput(kb, rounds):
+    """Max sustained report rate, acked (pipelined) and fire-and-forget."""
+    first = _echo(kb)
+    t0 = time.perf_counter()
+    inflight = deque()
+    replies = 0
+    for _ in range(rounds):
+        if len(inflight) >= BENCH_WINDOW:
+            replies += inflight.popleft().wait() is not None
+        inflight.append(kb.submit(bytes([0x15])))
+    while inflight:
+        replies += inflight.popleft().wait() is not None
+    host_s = time.perf_counter() - t0
+    last = _echo(kb)
+    if first and last:
+        fw_s = max(1, last[0] - first[0]) / 1000
+        print(f"  acked, {BENCH_WINDOW} in flight: {replies}/{rounds} replies, "
+              f"{rounds / host_s:6.0f} reports/s host, {((last[1] - first[1]) & 0xFFFF) / fw_s:6.0f}/s on device")
+
+    first = _echo(kb)
+    t0 = time.perf_counter()
+    for _ in range(rounds):
+        kb._post(bytes([0x15]))
+    host_s = time.perf_counter() - t0
+    last = _echo(kb)
+    if first and last:
+        arrived = ((last[1] - first[1]) & 0xFFFF) - 1  # minus the closing echo
+        fw_s = max(1, last[0] - first[0]) / 1000
+        print(f"  no-ack flood: {arrived}/{rounds} arrived, {rounds / host_s:6.0f} reports/s host, "
+              f"{arrived / fw_s:6.0f}/s on device")
+
+
+def bench_jitter(samples):
+    """How late select() wakes the loop past its deadline."""
+    late = []
+    for _ in range(samples):
+        t0 = time.monotonic()
+        select.select([], [], [], POLL_INTERVAL)
+        late.append(max(0.0, time.monotonic() - t0 - POLL_INTERVAL))
+    print(f"  wake-up lateness at {POLL_INTERVAL * 1000:.0f} ms: {_summary(late)}")
+
+
+def bench_keys(kb, waker, seconds):
+    """Key press (firmware scan time) → activate_iterm_tab() returned."""
+    print(f"  Press session keys for {seconds}s (Ctrl-C to skip)...")
+    iterm = os.environ.get("ITERM_SESSION_ID", "")
+    dispatch, total = [], []
+    end = time.monotonic() + seconds
+    try:
+        while time.monotonic() < end:
+            select.select([waker], [], [], max(0.0, end - time.monotonic()))
+            waker.clear()
+            while (key := kb.poll_key_event()):
+                if key.type != EV_KEY_DOWN:
                     continue
-                led = SLOT_LEDS[sess.slot]
-                if last_pulse_v.get(led) != v:
-                    kb.set_led(led, ORANGE_H, ORANGE_S, v)
-                    last_pulse_v[led] = v
-
-        # 7. Animate breathing for "working" LEDs (keyboard required)
-        if kb:
-            has_working = any(s.state == "working" for s in mgr.sessions.values())
-            if has_working:
-                stale_ids = {s.session_id for s in mgr.get_dimmed()}
-                t = now % BREATHE_PERIOD
-                breathe = (math.sin(t / BREATHE_PERIOD * 2 * math.pi - math.pi / 2) + 1) / 2
-                bv = int(BREATHE_MIN_V + (BREATHE_MAX_V - BREATHE_MIN_V) * breathe)
-                bv = bv // PULSE_QUANT * PULSE_QUANT
-                for sess in mgr.sessions.values():
-                    if sess.state != "working" or sess.session_id in stale_ids:
-                        continue
-                    led = SLOT_LEDS[sess.slot]
-                    if last_pulse_v.get(led) != bv:
-                        kb.set_led(led, ORANGE_H, ORANGE_S, bv)
-                        last_pulse_v[led] = bv
-
-        time.sleep(0.05)
+                dispatch.append(time.monotonic() - key.t)
+                activate_iterm_tab(iterm)
+                total.append(time.monotonic() - key.t)
+    except KeyboardInterrupt:
+        pass
+    print(f"  key → dispatch:     {_summary(dispatch)}")
+    print(f"  key → iTerm called: {_summary(total)}" + ("" if iterm else "  (no $ITERM_SESSION_ID)"))
+
+
+def benchmark(rounds=BENCH_ROUNDS):
+    """Measure the Raw HID protocol on a connected keyboard. Stop the daemon first."""
+    waker = Waker()
+    kb = RawHIDProtocol(on_wake=waker.set)
+    if not kb.connect():
+        print("No Raw HID keyboard found.")
+        return 1
+    if _echo(kb) is None:
+        print("Firmware has no echo command (0x15); build the raw_hid keymap with RAW_HID_PERF_ENABLE.")
+        kb.close()
+        return 1
+    kb.enter_direct_mode()
+    try:
+        print(f"Round trip, {rounds} each:")
+        bench_latency(kb, rounds)
+        print("Throughput:")
+        bench_throughput(kb, rounds * 4)
+        print("Main loop:")
+        bench_jitter(BENCH_JITTER_SAMPLES)
+        print("Keys:")
+        bench_keys(kb, waker, BENCH_KEY_SECONDS)
+    finally:
+        kb.restore_effect()
+        kb.close()
+    return 0
 
 
 if __name__ == "__main__":
+    if "--bench" in sys.argv:
+        sys.exit(benchmark())
     main()